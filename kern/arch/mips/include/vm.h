@@ -30,6 +30,9 @@
 #ifndef _MIPS_VM_H_
 #define _MIPS_VM_H_
 
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 /*
  * Machine-dependent VM system definitions.
@@ -112,8 +115,18 @@ struct tlbshootdown {
 	/*
 	 * Change this to what you need for your VM design.
 	 */
+#if OPT_A3
+	/*
+	 * The page and the address space id it has on the target cpu,
+	 * with its generation. No address space pointer, so that the
+	 * address space can go away before the target gets to it.
+	 */
+	vaddr_t ts_vaddr;
+	uint32_t ts_asid;
+#else
 	struct addrspace *ts_addrspace;
 	vaddr_t ts_vaddr;
+#endif //OPT_A3
 };
 
 #define TLBSHOOTDOWN_MAX 16
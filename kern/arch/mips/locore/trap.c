@@ -201,6 +201,20 @@ mips_trap(struct trapframe *tf)
 		goto done2;
 	}
 
+#if OPT_A3
+	/*
+	 * Most TLB misses are for pages that are mapped and resident, and
+	 * only need the entry reloaded from the page table. Do that here,
+	 * with interrupts still off, and skip vm_fault entirely. Go out
+	 * through done: vm_tlbrefill leaves the stored spl where it was,
+	 * which may have turned interrupts back on.
+	 */
+	if ((code == EX_TLBL || code == EX_TLBS) &&
+	    vm_tlbrefill(tf->tf_vaddr, code == EX_TLBS)) {
+		goto done;
+	}
+#endif //OPT_A3
+
 	/*
 	 * The processor turned interrupts off when it took the trap.
 	 *
@@ -40,6 +40,11 @@
 #include "opt-A2.h"
 #include <addrspace.h>
 //ASST2
+//ASST3
+#include "opt-A3.h"
+#include <copyinout.h>
+#include <kmem_cache.h>
+//ASST3
 
 /*
  * System call dispatcher.
@@ -79,6 +84,35 @@
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
  */
+
+#if OPT_A3
+/*
+ * mmap(addr, len, prot, flags, fd, offset) has two more arguments than
+ * fit in registers: fd at sp+16, and the 64-bit offset aligned up to
+ * sp+24.
+ */
+static
+int
+syscall_mmap(struct trapframe *tf, int32_t *retval)
+{
+    int fd;
+    off_t offset;
+    int err;
+
+    err = copyin((const_userptr_t)(tf->tf_sp + 16), &fd, sizeof(fd));
+    if (err) {
+        return err;
+    }
+    err = copyin((const_userptr_t)(tf->tf_sp + 24), &offset, sizeof(offset));
+    if (err) {
+        return err;
+    }
+    return sys_mmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+                    (int)tf->tf_a2, (int)tf->tf_a3, fd, offset,
+                    (vaddr_t *)retval);
+}
+#endif //OPT_A3
+
 void
 syscall(struct trapframe *tf)
 {
@@ -147,6 +181,38 @@ syscall(struct trapframe *tf)
 
 #endif //OPT_A2
 
+#if OPT_A3
+
+        case SYS_sbrk:
+            err = sys_sbrk((intptr_t)tf->tf_a0, (vaddr_t *)&retval);
+            break;
+
+        case SYS_open:
+            err = sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1, &retval);
+            break;
+
+        case SYS_close:
+            err = sys_close((int)tf->tf_a0);
+            break;
+
+        case SYS_fsync:
+            err = sys_fsync((int)tf->tf_a0);
+            break;
+
+        case SYS_mmap:
+            err = syscall_mmap(tf, &retval);
+            break;
+
+        case SYS_munmap:
+            err = sys_munmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1);
+            break;
+
+        case SYS_setaffinity:
+            err = sys_setaffinity((uint32_t)tf->tf_a0);
+            break;
+
+#endif //OPT_A3
+
 
 #endif // UW
 
@@ -204,7 +270,11 @@ enter_forked_process(struct trapframe *tf)
     struct trapframe stacktf;
 
     stacktf = *tf;
+#if OPT_A3
+    kmem_cache_free(trapframe_cache, tf);
+#else
     kfree(tf);
+#endif //OPT_A3
 
     stacktf.tf_v0 = 0;
     stacktf.tf_a3 = 0;
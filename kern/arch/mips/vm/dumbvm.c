@@ -39,6 +39,18 @@
 #include <vm.h>
 //ASST3
 #include "opt-A3.h"
+#include <pagetable.h>
+#include <uw-vmstats.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <cpu.h>
+#include <wchan.h>
+#include <thread.h>
+#include <swap.h>
+#include <pagecache.h>
+#include <kern/mman.h>
+#include <clock.h>
 //ASST3
 
 /*
@@ -47,7 +59,9 @@
  */
 
 /* under dumbvm, always have 48k of user stack */
+#if !OPT_A3
 #define DUMBVM_STACKPAGES    12
+#endif //!OPT_A3
 
 /*
  * Wrap rma_stealmem in a spinlock.
@@ -56,14 +70,208 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 
 #if OPT_A3
 
+//what a frame is being used for
+#define CM_FREE   0
+#define CM_KERNEL 1//alloc_kpages
+#define CM_USER   2//user page, see refs
+
 struct  coremap_t {
     paddr_t pa;
-    int num;
+    int state;
+    int len;//frames in the allocation that starts here, 0 if none does
+    int refs;//page tables mapping this frame (user pages only)
+    struct addrspace *as;//sole user mapping, if it may be evicted
+    vaddr_t vaddr;//where as maps it
+    pte_t *cachepte;//page cache entry holding it, see cache_putpage
+    bool busy;//being evicted
+    bool referenced;//touched since the clock hand last passed
+    int order;//first frame of a free block of 2^order frames, else -1
+    int next, prev;//neighbours on that order's free list, -1 at the ends
+    unsigned kmtag;//kmalloc's note on a kernel page, see kpage_settag
 };
 
 struct  coremap_t*  coremap;
 int total_frames;
 
+//frames are laid out in address order, so the entry is just arithmetic
+#define COREMAP_INDEX(addr) (((addr) - coremap[0].pa) / PAGE_SIZE)
+
+/*
+ * Free frames are kept by a binary buddy allocator: a block of order k
+ * is 2^k frames starting at a coremap index that is a multiple of 2^k,
+ * and its buddy is the block it was split from. Freed blocks merge
+ * with their buddy whenever it's free too.
+ */
+#define BUDDY_ORDERS 16
+
+//first free block of each order, -1 if none
+static int buddy_free[BUDDY_ORDERS];
+static unsigned buddy_nfree[BUDDY_ORDERS];
+static unsigned buddy_freeframes;
+
+/*
+ * Frames zeroed ahead of time by idle cpus, linked through their
+ * coremap next fields. They count as allocated, but they're only
+ * spare memory: getppages hands them back before failing.
+ */
+#define ZPOOL_MAX 32
+static int zpool_head = -1;
+static unsigned zpool_count;
+
+/*
+ * TLB address space ids are handed out per cpu, in order, tagged with
+ * a generation number in the bits above the id itself. When a cpu runs
+ * out it flushes its TLB and starts a new generation, which makes every
+ * id from the old one stale.
+ */
+#define ASID_BITS        6
+#define ASID_MASK        ((1 << ASID_BITS) - 1)
+#define ASID_FIRSTGEN    (1 << ASID_BITS)
+#define ASID_GEN(ctx)    ((ctx) & ~(uint32_t)ASID_MASK)
+#define ASID_TLBHI(ctx)  (((ctx) & ASID_MASK) << TLBHI_PIDSHIFT)
+
+//per cpu: the last id handed out there, and the one loaded now
+static uint32_t asid_last[MAXCPUS];
+static uint32_t asid_current[MAXCPUS];
+
+//per cpu: TLB slots from here up are still empty since the last flush
+static unsigned tlb_nextfree[MAXCPUS];
+
+//where vm_evict looks for its next victim
+static int evict_hand;
+//owners of pages being evicted wait here
+static struct wchan *vm_evict_wchan;
+
+static paddr_t vm_evict(void);
+
+#endif //OPT_A3
+
+#if OPT_A3
+
+static
+void
+buddy_insert(int i, int order)
+{
+	coremap[i].order = order;
+	coremap[i].prev = -1;
+	coremap[i].next = buddy_free[order];
+	if (buddy_free[order] >= 0) {
+		coremap[buddy_free[order]].prev = i;
+	}
+	buddy_free[order] = i;
+	buddy_nfree[order]++;
+	buddy_freeframes += 1 << order;
+}
+
+static
+void
+buddy_remove(int i)
+{
+	int order = coremap[i].order;
+
+	KASSERT(order >= 0 && order < BUDDY_ORDERS);
+	if (coremap[i].prev >= 0) {
+		coremap[coremap[i].prev].next = coremap[i].next;
+	}
+	else {
+		buddy_free[order] = coremap[i].next;
+	}
+	if (coremap[i].next >= 0) {
+		coremap[coremap[i].next].prev = coremap[i].prev;
+	}
+	coremap[i].order = -1;
+	buddy_nfree[order]--;
+	buddy_freeframes -= 1 << order;
+}
+
+/* free the block of 2^ORDER frames at I, merging with its buddies */
+static
+void
+buddy_free_block(int i, int order)
+{
+	int buddy;
+
+	while (order < BUDDY_ORDERS - 1) {
+		buddy = i ^ (1 << order);
+		if (buddy + (1 << order) > total_frames ||
+		    coremap[buddy].order != order) {
+			break;
+		}
+		buddy_remove(buddy);
+		i &= buddy;
+		order++;
+	}
+	buddy_insert(i, order);
+}
+
+/* free frames [LO, HI), which needn't be a power of two long */
+static
+void
+buddy_free_range(int lo, int hi)
+{
+	int i, order;
+
+	for (i = lo; i < hi; i++) {
+		coremap[i].state = CM_FREE;
+		coremap[i].len = 0;
+		coremap[i].refs = 0;
+		coremap[i].as = NULL;
+	}
+
+	//carve the range into the largest aligned blocks that fit
+	while (lo < hi) {
+		order = 0;
+		while (order + 1 < BUDDY_ORDERS &&
+		       (lo & ((1 << (order + 1)) - 1)) == 0 &&
+		       lo + (1 << (order + 1)) <= hi) {
+			order++;
+		}
+		buddy_free_block(lo, order);
+		lo += 1 << order;
+	}
+}
+
+/*
+ * Allocate NPAGES contiguous frames and return the index of the
+ * first, or -1. The block found is split down to the smallest order
+ * that holds NPAGES, and whatever is left over past the end goes
+ * straight back.
+ */
+static
+int
+buddy_alloc(unsigned long npages)
+{
+	int i, j, order, want;
+
+	want = 0;
+	while (want < BUDDY_ORDERS && (1UL << want) < npages) {
+		want++;
+	}
+	order = want;
+	while (order < BUDDY_ORDERS && buddy_free[order] < 0) {
+		order++;
+	}
+	if (order >= BUDDY_ORDERS) {
+		return -1;
+	}
+
+	i = buddy_free[order];
+	buddy_remove(i);
+	while (order > want) {
+		order--;
+		buddy_insert(i + (1 << order), order);
+	}
+
+	for (j = i; j < i + (int)npages; j++) {
+		KASSERT(coremap[j].state == CM_FREE);
+		coremap[j].state = CM_KERNEL;
+		coremap[j].len = 0;
+	}
+	coremap[i].len = npages;
+	buddy_free_range(i + npages, i + (1 << want));
+	return i;
+}
+
 #endif //OPT_A3
 
 void
@@ -92,8 +300,37 @@ vm_bootstrap(void)
 	//fill up coremap
 	for (int i = 0; i < total_frames; i++) {
 		 coremap[i].pa = lo + i*PAGE_SIZE;
-		 coremap[i].num = 0;//free
+		 coremap[i].state = CM_FREE;
+		 coremap[i].len = 0;
+		 coremap[i].refs = 0;
+		 coremap[i].as = NULL;
+		 coremap[i].vaddr = 0;
+		 coremap[i].cachepte = NULL;
+		 coremap[i].busy = false;
+		 coremap[i].referenced = false;
+		 coremap[i].order = -1;
+		 coremap[i].kmtag = 0;
+	}
+	for (int i = 0; i < BUDDY_ORDERS; i++) {
+		buddy_free[i] = -1;
+		buddy_nfree[i] = 0;
+	}
+	buddy_freeframes = 0;
+	buddy_free_range(0, total_frames);
+
+	for (int i = 0; i < MAXCPUS; i++) {
+		asid_last[i] = ASID_FIRSTGEN;
+		asid_current[i] = 0;
+	}
+
+	vmstats_init();
+
+	vm_evict_wchan = wchan_create("vm_evict");
+	if (vm_evict_wchan == NULL) {
+		panic("vm_bootstrap: out of memory\n");
 	}
+	swap_bootstrap();
+	pagecache_bootstrap();
 
 #else	
 
@@ -112,41 +349,24 @@ getppages(unsigned long npages)
 
 #if OPT_A3
 
-	bool found;
-	int i,j;
-	
+	int i;
+
 	if ( coremap == NULL) {
 		//before coremap initialized, still let kernel to steal memory
 		addr = ram_stealmem(npages);		
 	}else{
-		//search successive free frames
-		int temp_pages = npages;
-		addr = 0;//assume no free frames to allocate
-		
-		for (i = 0; i < total_frames; i = j + 1) {
-			found = true;
-			if((i + temp_pages) > total_frames) {
-				found = false;
-				break;
-			}
-			//find npages free frames
-			for (j = i; j < i + temp_pages; j++) {
-				if ( coremap[j].num != 0) {
-					found = false;
-					break;
-				}
-			}
-			//found,fill num with a sequence num as occupied 
-			if (found) {
-				int num = 1;
-				for (j = i; j < i + temp_pages; j++) {
-					coremap[j].num = num;
-					num++;
-				}
-				addr=  coremap[i].pa;//got allocated	
-				break;
+		i = buddy_alloc(npages);
+		if (i < 0 && zpool_count > 0) {
+			//out of memory; the zeroed pool is the first to go
+			while (zpool_head >= 0) {
+				i = zpool_head;
+				zpool_head = coremap[i].next;
+				buddy_free_range(i, i + 1);
 			}
+			zpool_count = 0;
+			i = buddy_alloc(npages);
 		}
+		addr = i < 0 ? 0 : coremap[i].pa;
 	}
 
 #else
@@ -165,6 +385,14 @@ alloc_kpages(int npages)
 {
 	paddr_t pa;
 	pa = getppages(npages);
+#if OPT_A3
+	//out of frames: push a user page out to make room, if we're in a
+	//position to sleep on the disk
+	if (pa == 0 && npages == 1 && coremap != NULL &&
+	    !curthread->t_in_interrupt && curthread->t_curspl == 0) {
+		pa = vm_evict();
+	}
+#endif //OPT_A3
 	if (pa==0) {
 		return 0;
 	}
@@ -176,57 +404,1322 @@ free_kpages(vaddr_t addr)
 {
 
 #if OPT_A3
+	paddr_t pa;
+	int i, j;
+
+	pa = addr - MIPS_KSEG0;
+	if (coremap == NULL || pa < coremap[0].pa || (pa & ~PAGE_FRAME) != 0 ||
+	    COREMAP_INDEX(pa) >= (unsigned)total_frames) {
+		panic("wrong pointer to free!\n");
+	}
+	i = COREMAP_INDEX(pa);
+
 	spinlock_acquire(&stealmem_lock);
+
+	//only the first frame of an allocation may be freed
+	if (coremap[i].state == CM_FREE || coremap[i].len == 0) {
+		panic("wrong pointer to free!\n");
+	}
+	for (j = i; j < i + coremap[i].len; j++) {
+		KASSERT(coremap[j].state != CM_FREE);
+		KASSERT(!coremap[j].busy);
+	}
+	buddy_free_range(i, i + coremap[i].len);
+
+	spinlock_release(&stealmem_lock);
+
+#else
+
+	/* nothing - leak the memory. */
+
+	(void)addr;
 	
+#endif //OPT_A3 
+}
+
+#if OPT_A3
+
+/*
+ * A word kmalloc keeps with each of its pages. Pages from before the
+ * coremap was set up have none and always read as 0. No lock: a tag is
+ * only changed while kmalloc has the page to itself, and only read by
+ * whoever holds a block on it.
+ */
+void
+kpage_settag(vaddr_t addr, unsigned tag)
+{
+	paddr_t pa = addr - MIPS_KSEG0;
+
+	if (coremap != NULL && pa >= coremap[0].pa &&
+	    COREMAP_INDEX(pa) < (unsigned)total_frames) {
+		coremap[COREMAP_INDEX(pa)].kmtag = tag;
+	}
+}
+
+unsigned
+kpage_gettag(vaddr_t addr)
+{
+	paddr_t pa = addr - MIPS_KSEG0;
+
+	if (coremap != NULL && pa >= coremap[0].pa &&
+	    COREMAP_INDEX(pa) < (unsigned)total_frames) {
+		return coremap[COREMAP_INDEX(pa)].kmtag;
+	}
+	return 0;
+}
+
+bool
+kpage_isstolen(vaddr_t addr)
+{
+	paddr_t pa = addr - MIPS_KSEG0;
+
+	return coremap == NULL || pa < coremap[0].pa;
+}
+
+#endif //OPT_A3
+
+#if OPT_A3
+
+void
+coremap_printstats(void)
+{
+	unsigned freeframes;
+	int order;
+
+	/* print the whole thing with interrupts off */
+	spinlock_acquire(&stealmem_lock);
+
+	freeframes = 0;
+	for (order = 0; order < BUDDY_ORDERS; order++) {
+		freeframes += buddy_nfree[order] << order;
+	}
+	kprintf("Buddy allocator status: %u of %d frames free\n",
+		freeframes, total_frames);
+	kprintf("Zeroed pool: %u frames\n", zpool_count);
+	kprintf("  order    pages  free blocks\n");
+	for (order = 0; order < BUDDY_ORDERS; order++) {
+		kprintf("  %5d  %7d  %11u\n", order, 1 << order,
+			buddy_nfree[order]);
+	}
+
+	spinlock_release(&stealmem_lock);
+}
+
+/*
+ * Take a frame from the zeroed pool, allocated as if by getppages(1).
+ * Returns 0 if the pool is empty.
+ */
+static
+paddr_t
+zpool_take(void)
+{
 	int i;
-	bool wrongpointer = false;
-	
-	for (i = 0; i < total_frames; i++) {
-		if(PADDR_TO_KVADDR(coremap[i].pa) == addr) {			
-			//the first number of allocated frame  must be 1
-			if(coremap[i].num != 1){
-				wrongpointer = true;
-				break;	
-			}
-			//when sequence number is matched, clear the number as free
-			int j = i;
-			int num = 1;
-			while ( coremap[j].num == num) {
-				coremap[j].num = 0;
-				num++;
-				j++;
-			}
-			break;
+
+	spinlock_acquire(&stealmem_lock);
+	i = zpool_head;
+	if (i >= 0) {
+		zpool_head = coremap[i].next;
+		zpool_count--;
+	}
+	spinlock_release(&stealmem_lock);
+
+	if (i < 0) {
+		vmstats_inc(VMSTAT_ZERO_POOL_MISS);
+		return 0;
+	}
+	vmstats_inc(VMSTAT_ZERO_POOL_HIT);
+	return coremap[i].pa;
+}
+
+bool
+vm_idle(void)
+{
+	int i;
+
+	if (coremap == NULL) {
+		return false;
+	}
+
+	//don't tie up frames somebody may be about to need
+	spinlock_acquire(&stealmem_lock);
+	if (zpool_count >= ZPOOL_MAX || buddy_freeframes < 2 * ZPOOL_MAX) {
+		spinlock_release(&stealmem_lock);
+		return false;
+	}
+	i = buddy_alloc(1);
+	spinlock_release(&stealmem_lock);
+	if (i < 0) {
+		return false;
+	}
+
+	bzero((void *)PADDR_TO_KVADDR(coremap[i].pa), PAGE_SIZE);
+
+	spinlock_acquire(&stealmem_lock);
+	coremap[i].next = zpool_head;
+	zpool_head = i;
+	zpool_count++;
+	spinlock_release(&stealmem_lock);
+	return true;
+}
+
+vaddr_t
+alloc_zkpage(void)
+{
+	paddr_t pa;
+	vaddr_t va;
+
+	pa = zpool_take();
+	if (pa != 0) {
+		return PADDR_TO_KVADDR(pa);
+	}
+	va = alloc_kpages(1);
+	if (va != 0) {
+		bzero((void *)va, PAGE_SIZE);
+	}
+	return va;
+}
+
+/* hand out one frame for a user page, referenced once by the caller */
+static
+paddr_t
+getuserframe(void)
+{
+	paddr_t pa;
+
+	pa = getppages(1);
+	if (pa == 0) {
+		pa = vm_evict();
+		if (pa == 0) {
+			return 0;
+		}
+	}
+	spinlock_acquire(&stealmem_lock);
+	coremap[COREMAP_INDEX(pa)].state = CM_USER;
+	coremap[COREMAP_INDEX(pa)].refs = 1;
+	coremap[COREMAP_INDEX(pa)].as = NULL;
+	coremap[COREMAP_INDEX(pa)].cachepte = NULL;
+	spinlock_release(&stealmem_lock);
+	return pa;
+}
+
+/* same, but zero-filled */
+static
+paddr_t
+getuserpage(void)
+{
+	paddr_t pa;
+
+	pa = zpool_take();
+	if (pa == 0) {
+		pa = getuserframe();
+		if (pa != 0) {
+			bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
 		}
+		return pa;
+	}
+	spinlock_acquire(&stealmem_lock);
+	coremap[COREMAP_INDEX(pa)].state = CM_USER;
+	coremap[COREMAP_INDEX(pa)].refs = 1;
+	coremap[COREMAP_INDEX(pa)].as = NULL;
+	coremap[COREMAP_INDEX(pa)].cachepte = NULL;
+	spinlock_release(&stealmem_lock);
+	return pa;
+}
+
+/*
+ * Another page table now maps the frame at PA. Shared frames have no
+ * single owner to take them away from, so they can't be evicted.
+ * Called with stealmem_lock held.
+ */
+static
+void
+shareuserpage(paddr_t pa)
+{
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+	KASSERT(coremap[COREMAP_INDEX(pa)].refs > 0);
+	coremap[COREMAP_INDEX(pa)].refs++;
+	coremap[COREMAP_INDEX(pa)].as = NULL;
+}
+
+/* drop one reference; the frame is freed with the last one */
+static
+void
+freeuserpage(paddr_t pa)
+{
+	bool last;
+
+	spinlock_acquire(&stealmem_lock);
+	KASSERT(coremap[COREMAP_INDEX(pa)].state == CM_USER);
+	KASSERT(coremap[COREMAP_INDEX(pa)].refs > 0);
+	coremap[COREMAP_INDEX(pa)].refs--;
+	coremap[COREMAP_INDEX(pa)].as = NULL;
+	last = coremap[COREMAP_INDEX(pa)].refs == 0;
+	spinlock_release(&stealmem_lock);
+
+	if (last) {
+		free_kpages(PADDR_TO_KVADDR(pa));
+	}
+}
+
+paddr_t
+alloc_upage(void)
+{
+	return getuserpage();
+}
+
+void
+free_upage(paddr_t pa)
+{
+	freeuserpage(pa);
+}
+
+void
+cache_putpage(pte_t *pte, paddr_t pa)
+{
+	struct coremap_t *cm = &coremap[COREMAP_INDEX(pa)];
+
+	spinlock_acquire(&stealmem_lock);
+	KASSERT(*pte == 0);
+	KASSERT(cm->state == CM_USER && cm->refs == 1);
+	cm->cachepte = pte;
+	cm->referenced = true;
+	*pte = pa | PTE_VALID;
+	//the caller's own, before the clock can see the frame unmapped
+	shareuserpage(pa);
+	spinlock_release(&stealmem_lock);
+}
+
+paddr_t
+cache_getpage(pte_t *pte)
+{
+	paddr_t pa;
+
+	pa = 0;
+	spinlock_acquire(&stealmem_lock);
+	if (*pte & PTE_VALID) {
+		pa = PTE_PADDR(*pte);
+		shareuserpage(pa);
+		coremap[COREMAP_INDEX(pa)].referenced = true;
+	}
+	spinlock_release(&stealmem_lock);
+	return pa;
+}
+
+void
+cache_cleanpage(pte_t *pte)
+{
+	spinlock_acquire(&stealmem_lock);
+	*pte &= ~PTE_DIRTY;
+	spinlock_release(&stealmem_lock);
+}
+
+void
+cache_droppage(pte_t *pte)
+{
+	paddr_t pa;
+
+	spinlock_acquire(&stealmem_lock);
+	if (!(*pte & PTE_VALID)) {
+		spinlock_release(&stealmem_lock);
+		return;
+	}
+	pa = PTE_PADDR(*pte);
+	coremap[COREMAP_INDEX(pa)].cachepte = NULL;
+	*pte = 0;
+	spinlock_release(&stealmem_lock);
+	freeuserpage(pa);
+}
+
+/*
+ * Record that the frame at PA is mapped at VADDR by AS alone, which
+ * makes it a candidate for eviction. Either way it has just been used,
+ * so it gets a second chance from the clock. Called with stealmem_lock
+ * held.
+ */
+static
+void
+ownuserpage(paddr_t pa, struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_t *cm = &coremap[COREMAP_INDEX(pa)];
+
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+	cm->referenced = true;
+	if (cm->refs == 1) {
+		cm->as = as;
+		cm->vaddr = vaddr;
+	}
+}
+
+/*
+ * Wait for an eviction in progress to finish. Called and returns with
+ * stealmem_lock held; anything looked at under it must be rechecked.
+ */
+static
+void
+vm_wait_busy(void)
+{
+	wchan_lock(vm_evict_wchan);
+	spinlock_release(&stealmem_lock);
+	wchan_sleep(vm_evict_wchan);
+	spinlock_acquire(&stealmem_lock);
+}
+
+static
+bool
+as_istext(struct addrspace *as, vaddr_t vaddr)
+{
+	return vaddr >= as->as_vbase1 &&
+		vaddr < as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
+}
+
+/* a page of AS has become resident, or stopped being; lock held */
+static
+void
+as_resident_inc(struct addrspace *as)
+{
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+	as->as_resident++;
+	if (as->as_resident > as->as_maxresident) {
+		as->as_maxresident = as->as_resident;
+	}
+}
+
+static
+void
+as_resident_dec(struct addrspace *as)
+{
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+	KASSERT(as->as_resident > 0);
+	as->as_resident--;
+}
+
+/* the mapping VADDR is in, if any */
+static
+struct mmap_region *
+as_findmap(struct addrspace *as, vaddr_t vaddr)
+{
+	struct mmap_region *mr;
+
+	for (mr = as->as_maps; mr != NULL; mr = mr->mr_next) {
+		if (vaddr >= mr->mr_base &&
+		    vaddr < mr->mr_base + mr->mr_npages * PAGE_SIZE) {
+			return mr;
+		}
+	}
+	return NULL;
+}
+
+/* c0_entryhi for VADDR in the address space this cpu is running */
+static
+uint32_t
+tlb_hi(vaddr_t vaddr)
+{
+	return (vaddr & TLBHI_VPAGE) |
+		ASID_TLBHI(asid_current[curcpu->c_number]);
+}
+
+/* put back the address space id the other TLB functions clobber */
+static
+void
+tlb_restoreasid(void)
+{
+	tlb_setasid(ASID_TLBHI(asid_current[curcpu->c_number]));
+}
+
+/*
+ * Load a translation for VADDR in the current address space into the
+ * TLB: take a slot that hasn't been used since the last flush if there
+ * is one, otherwise let the processor pick a victim. Returns true if
+ * it replaced an entry. Call with interrupts off.
+ */
+static
+bool
+tlb_load(vaddr_t vaddr, uint32_t elo)
+{
+	uint32_t ehi;
+	unsigned i;
+
+	//fill the TLB in order after a flush rather than searching it;
+	//holes left by invalidations are simply reused at random later
+	ehi = tlb_hi(vaddr);
+	i = tlb_nextfree[curcpu->c_number];
+	if (i < NUM_TLB) {
+		tlb_nextfree[curcpu->c_number] = i + 1;
+		tlb_write(ehi, elo, i);
+		return false;
+	}
+
+	tlb_random(ehi, elo);
+	return true;
+}
+
+/* same, counting it; interrupts needn't be off */
+static
+void
+tlb_install(vaddr_t vaddr, uint32_t elo)
+{
+	bool replaced;
+	int spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+	replaced = tlb_load(vaddr, elo);
+	splx(spl);
+	vmstats_inc(replaced ? VMSTAT_TLB_FAULT_REPLACE :
+		    VMSTAT_TLB_FAULT_FREE);
+}
+
+/* Replace the TLB entry for the page at VADDR, which must be loaded. */
+static
+void
+tlb_update(vaddr_t vaddr, uint32_t elo)
+{
+	uint32_t ehi;
+	int i, spl;
+
+	spl = splhigh();
+	ehi = tlb_hi(vaddr);
+	i = tlb_probe(ehi, 0);
+	if (i >= 0) {
+		tlb_write(ehi, elo, i);
+	}
+	else {
+		tlb_random(ehi, elo);
+	}
+	splx(spl);
+}
+
+/* Throw away every translation in this CPU's TLB. */
+static
+void
+tlb_flush(void)
+{
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	tlb_nextfree[curcpu->c_number] = 0;
+	tlb_restoreasid();
+	vmstats_inc(VMSTAT_TLB_INVALIDATE);
+	splx(spl);
+}
+
+/*
+ * Return AS's address space id on this cpu, handing it a new one if
+ * it has none from the current generation. Call with interrupts off.
+ */
+static
+uint32_t
+as_getasid(struct addrspace *as)
+{
+	unsigned cpu = curcpu->c_number;
+	uint32_t ctx;
+
+	ctx = as->as_asid[cpu];
+	if (ctx != 0 && ASID_GEN(ctx) == ASID_GEN(asid_last[cpu])) {
+		return ctx;
+	}
+
+	ctx = ++asid_last[cpu];
+	if ((ctx & ASID_MASK) == 0) {
+		//out of ids: nothing tagged with the old generation may survive
+		tlb_flush();
+		vmstats_inc(VMSTAT_ASID_ROLLOVER);
+	}
+	as->as_asid[cpu] = ctx;
+	vmstats_inc(VMSTAT_ASID_ASSIGN);
+	return ctx;
+}
+
+/*
+ * Drop this CPU's translation for VADDR under address space id CTX, if
+ * CTX is from the current generation. Call with interrupts off.
+ */
+static
+void
+tlb_invalidate_asid(uint32_t ctx, vaddr_t vaddr)
+{
+	int i;
+
+	if (ctx != 0 && ASID_GEN(ctx) == ASID_GEN(asid_last[curcpu->c_number])) {
+		i = tlb_probe((vaddr & TLBHI_VPAGE) | ASID_TLBHI(ctx), 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+		tlb_restoreasid();
+	}
+}
+
+/*
+ * Drop this CPU's translation for the page at VADDR in AS, if it has
+ * one. AS needn't be the address space running here.
+ */
+static
+void
+tlb_invalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	int spl;
+
+	spl = splhigh();
+	tlb_invalidate_asid(as->as_asid[curcpu->c_number], vaddr);
+	splx(spl);
+}
+
+/*
+ * Queue the invalidation of AS's page at VADDR for every other cpu AS
+ * has an address space id on, and add them to the bitmask *TARGETS for
+ * ipi_tlbshootdown_wait. Nowhere else can have the page: ids that were
+ * dropped are never seen again before a flush. Ids from an old
+ * generation are sent anyway and ignored by the target.
+ * Call with stealmem_lock held.
+ */
+static
+void
+tlb_shootdown_post(struct addrspace *as, vaddr_t vaddr, uint32_t *targets)
+{
+	struct tlbshootdown ts;
+	unsigned cpu;
+
+	ts.ts_vaddr = vaddr;
+	for (cpu = 0; cpu < MAXCPUS; cpu++) {
+		ts.ts_asid = as->as_asid[cpu];
+		if (cpu == curcpu->c_number || ts.ts_asid == 0) {
+			continue;
+		}
+		ipi_tlbshootdown_post(cpu, &ts);
+		*targets |= (uint32_t)1 << cpu;
+	}
+}
+
+/*
+ * Make whatever AS has in other cpus' TLBs unreachable by throwing away
+ * its address space ids there; they aren't handed out again until that
+ * cpu's next generation, which starts with a flush. No IPI is needed
+ * because processes are single-threaded: AS isn't running anywhere but
+ * here. With HERE, do the same on this cpu and load the new id.
+ */
+static
+void
+as_tlb_forget(struct addrspace *as, bool here)
+{
+	unsigned cpu;
+	int spl;
+
+	spl = splhigh();
+	for (cpu = 0; cpu < MAXCPUS; cpu++) {
+		if (cpu != curcpu->c_number || here) {
+			as->as_asid[cpu] = 0;
+		}
+	}
+	if (here && as == curproc_getas()) {
+		asid_current[curcpu->c_number] = as_getasid(as);
+		tlb_restoreasid();
+	}
+	splx(spl);
+}
+
+/*
+ * Take a frame away from some user page and hand it to the caller,
+ * already allocated. Data and stack pages are written to swap; text
+ * is simply dropped, since it can be read back from the executable,
+ * and so is a clean page cache frame nobody maps any more.
+ * Returns 0 if there is nothing to evict or nowhere to put it.
+ *
+ * Victims are chosen by the clock algorithm. The hardware keeps no
+ * reference bits, so they are emulated: a page's bit is set whenever
+ * it faults into the TLB, and when the hand passes a page with the bit
+ * set it clears it and drops the page from the TLBs, so that the next
+ * use faults and sets it again. A page the hand finds untouched since
+ * its last pass is the one to go. Other cpus are only told about those
+ * pages along with the victim, all in one IPI each, and only cpus the
+ * owner has run on are told at all.
+ *
+ * While the page is on its way out its PTE is marked PTE_BUSY and the
+ * owner waits in vm_wait_busy if it touches it.
+ */
+static
+paddr_t
+vm_evict(void)
+{
+	struct coremap_t *cm;
+	struct addrspace *as;
+	vaddr_t vaddr;
+	pte_t *pte, newpte;
+	uint32_t targets;
+	unsigned slot;
+	int i, result;
+
+	spinlock_acquire(&stealmem_lock);
+	cm = NULL;
+	targets = 0;
+	//two laps: by the second every bit the first cleared is still clear
+	for (i = 0; i < 2 * total_frames; i++) {
+		cm = &coremap[evict_hand];
+		evict_hand = (evict_hand + 1) % total_frames;
+		if (cm->state != CM_USER || cm->refs != 1 || cm->busy) {
+			continue;
+		}
+		//a cached page nobody maps goes too, unless not written back
+		if (cm->as == NULL &&
+		    (cm->cachepte == NULL || (*cm->cachepte & PTE_DIRTY))) {
+			continue;
+		}
+		if (!cm->referenced) {
+			break;
+		}
+		cm->referenced = false;
+		if (cm->as != NULL) {
+			tlb_invalidate(cm->as, cm->vaddr);
+			tlb_shootdown_post(cm->as, cm->vaddr, &targets);
+		}
+		vmstats_inc(VMSTAT_CLOCK_SECOND_CHANCE);
+	}
+	if (i == 2 * total_frames) {
+		spinlock_release(&stealmem_lock);
+		ipi_tlbshootdown_wait(targets);
+		return 0;
+	}
+
+	if (cm->as == NULL) {
+		//no TLB has it; the cache reads it back in if asked again
+		*cm->cachepte = 0;
+		cm->cachepte = NULL;
+		vmstats_inc(VMSTAT_EVICT);
+		KASSERT(cm->len == 1);
+		cm->state = CM_KERNEL;
+		cm->refs = 0;
+		spinlock_release(&stealmem_lock);
+		ipi_tlbshootdown_wait(targets);
+		return cm->pa;
+	}
+
+	as = cm->as;
+	vaddr = cm->vaddr;
+	pte = pt_lookup(as->as_pt, vaddr);
+	KASSERT(pte != NULL);
+	KASSERT((*pte & (PTE_VALID | PTE_BUSY)) == PTE_VALID);
+	KASSERT(PTE_PADDR(*pte) == cm->pa);
+	cm->busy = true;
+	*pte |= PTE_BUSY;
+	tlb_shootdown_post(as, vaddr, &targets);
+	spinlock_release(&stealmem_lock);
+
+	//nobody may write to the page while it's being copied out
+	tlb_invalidate(as, vaddr);
+	ipi_tlbshootdown_wait(targets);
+
+	if (as->as_loaded && as_istext(as, vaddr)) {
+		newpte = 0;
+		result = 0;
+	}
+	else {
+		newpte = 0;
+		result = swap_alloc(&slot);
+		if (!result) {
+			result = swap_out(cm->pa, slot);
+			if (result) {
+				swap_free(slot);
+			}
+			else {
+				newpte = PTE_MKSWAP(slot);
+				vmstats_inc(VMSTAT_SWAP_FILE_WRITE);
+			}
+		}
+	}
+
+	spinlock_acquire(&stealmem_lock);
+	if (result) {
+		//leave the page where it was
+		*pte &= ~PTE_BUSY;
+	}
+	else {
+		*pte = newpte;
+		as_resident_dec(as);
+		vmstats_inc(VMSTAT_EVICT);
+		//the caller's now, same as if getppages had found it
+		KASSERT(cm->len == 1);
+		cm->state = CM_KERNEL;
+		cm->refs = 0;
+		cm->as = NULL;
+	}
+	cm->busy = false;
+	wchan_wakeall(vm_evict_wchan);
+	spinlock_release(&stealmem_lock);
+
+	return result ? 0 : cm->pa;
+}
+
+#endif //OPT_A3
+
+void
+vm_tlbshootdown_all(void)
+{
+#if OPT_A3
+	tlb_flush();
+#else
+	panic("dumbvm tried to do tlb shootdown?!\n");
+#endif //OPT_A3
+}
+
+void
+vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+#if OPT_A3
+	int spl;
+
+	spl = splhigh();
+	tlb_invalidate_asid(ts->ts_asid, ts->ts_vaddr);
+	splx(spl);
+#else
+	(void)ts;
+	panic("dumbvm tried to do tlb shootdown?!\n");
+#endif //OPT_A3
+}
+
+#if OPT_A3
+
+/*
+ * Give the page behind PTE a private, writable frame. If nobody else
+ * maps the shared frame any more we simply take it over. Called and
+ * returns with stealmem_lock held.
+ */
+static
+int
+as_break_cow(struct addrspace *as, vaddr_t vaddr, pte_t *pte)
+{
+	struct coremap_t *cm;
+	paddr_t oldpa, newpa;
+	bool last;
+
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+	KASSERT(*pte & PTE_COW);
+	oldpa = PTE_PADDR(*pte);
+	cm = &coremap[COREMAP_INDEX(oldpa)];
+
+	if (cm->refs == 1) {
+		*pte &= ~PTE_COW;
+		ownuserpage(oldpa, as, vaddr);
+		return 0;
+	}
+
+	//the shared frame can't be evicted while we copy it, and only we
+	//change our own copy-on-write entries
+	spinlock_release(&stealmem_lock);
+	newpa = getuserframe();
+	if (newpa == 0) {
+		spinlock_acquire(&stealmem_lock);
+		return ENOMEM;
+	}
+	memmove((void *)PADDR_TO_KVADDR(newpa),
+		(const void *)PADDR_TO_KVADDR(oldpa), PAGE_SIZE);
+
+	spinlock_acquire(&stealmem_lock);
+	*pte = newpa | PTE_VALID;
+	ownuserpage(newpa, as, vaddr);
+	//other cpus may still map the shared frame read-only for us
+	as_tlb_forget(as, false);
+	KASSERT(cm->refs > 0);
+	cm->refs--;
+	cm->as = NULL;
+	last = cm->refs == 0;
+	if (last) {
+		spinlock_release(&stealmem_lock);
+		free_kpages(PADDR_TO_KVADDR(oldpa));
+		spinlock_acquire(&stealmem_lock);
+	}
+	return 0;
+}
+
+/*
+ * Fill the frame at PADDR with the contents of the user page at VADDR.
+ * Whatever part of the page overlaps [FILEVADDR, FILEVADDR+FILESIZE)
+ * is read from the executable; the rest is zero. *FROMDISK says
+ * whether anything actually had to be read.
+ */
+static
+int
+as_fill_page(struct addrspace *as, vaddr_t vaddr, paddr_t paddr,
+	     vaddr_t filevaddr, off_t fileoffset, size_t filesize,
+	     bool *fromdisk)
+{
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t lo, hi;
+	int result;
+
+	bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	*fromdisk = false;
+
+	lo = vaddr > filevaddr ? vaddr : filevaddr;
+	hi = vaddr + PAGE_SIZE;
+	if (hi > filevaddr + filesize) {
+		hi = filevaddr + filesize;
+	}
+	if (lo >= hi) {
+		//all bss (or past the end of the file data)
+		return 0;
+	}
+
+	KASSERT(as->as_vnode != NULL);
+	uio_kinit(&iov, &ku, (void *)(PADDR_TO_KVADDR(paddr) + (lo - vaddr)),
+		  hi - lo, fileoffset + (lo - filevaddr), UIO_READ);
+	result = VOP_READ(as->as_vnode, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("ELF: short read on page - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	*fromdisk = true;
+	return 0;
+}
+
+/*
+ * FAULTADDRESS is below the stack. Grow the stack down over it if it's
+ * close enough to the bottom to be a push, the stack stays within its
+ * limit, and a guard page is left above the heap.
+ */
+static
+int
+as_grow_stack(struct addrspace *as, vaddr_t faultaddress)
+{
+	vaddr_t heaptop;
+
+	heaptop = ROUNDUP(as->as_heaptop, PAGE_SIZE);
+
+	if (faultaddress >= as->as_stackbase ||
+	    as->as_stackbase - faultaddress > STACK_GROWWINDOW ||
+	    USERSTACK - faultaddress > as->as_stacklimit ||
+	    faultaddress < heaptop + PAGE_SIZE) {
+		return EFAULT;
+	}
+	as->as_stackbase = faultaddress & PAGE_FRAME;
+	return 0;
+}
+
+/* how as_pagein found the page */
+#define PAGEIN_RESIDENT 0	/* already in memory */
+#define PAGEIN_ZERO     1	/* zero-filled */
+#define PAGEIN_ELF      2	/* read from the executable */
+#define PAGEIN_SWAP     3	/* read back from swap */
+#define PAGEIN_FILE     4	/* read into the page cache of a mapped file */
+
+/*
+ * Make the page at VADDR resident. Text and data come from the
+ * executable as far as it goes (text through the program's shared page
+ * cache, if it has one), evicted pages from swap, mapped files from
+ * their page cache, and everything else is zero-filled. *HOW says which
+ * it was.
+ *
+ * Called with stealmem_lock held. On success it is still held and
+ * *PTE is valid and not busy; on failure it has been released.
+ */
+static
+int
+as_pagein(struct addrspace *as, vaddr_t vaddr, pte_t *pte, int *how)
+{
+	vaddr_t vbase2, vtop2;
+	paddr_t paddr;
+	pte_t flags;
+	struct mmap_region *mr;
+	unsigned slot;
+	bool fromdisk;
+	int result;
+
+	KASSERT(spinlock_do_i_hold(&stealmem_lock));
+
+	while (*pte & PTE_BUSY) {
+		vm_wait_busy();
+	}
+	if (*pte & PTE_VALID) {
+		//page table hit: the page is resident, only the TLB lost it
+		ownuserpage(PTE_PADDR(*pte), as, vaddr);
+		*how = PAGEIN_RESIDENT;
+		return 0;
+	}
+
+	//nothing else touches our entries unless they're resident, so
+	//the lock isn't needed while the page is being read in
+	spinlock_release(&stealmem_lock);
+
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	flags = PTE_VALID;
+
+	if (*pte & PTE_SWAPPED) {
+		slot = PTE_SLOT(*pte);
+		paddr = getuserframe();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		result = swap_in(paddr, slot);
+		if (result) {
+			freeuserpage(paddr);
+			return result;
+		}
+		swap_free(slot);
+		*how = PAGEIN_SWAP;
+	}
+	else if (as_istext(as, vaddr) && as->as_textcache != NULL &&
+		 vaddr < as->as_filevaddr1 + as->as_filesize1) {
+		//the whole file page, shared with everyone running this
+		//program; it is never written, so needs no copy-on-write
+		result = pagecache_getpage(as->as_textcache,
+					   as->as_fileoffset1 +
+					   ((off_t)vaddr - as->as_filevaddr1),
+					   &paddr, &fromdisk);
+		if (result) {
+			return result;
+		}
+		*how = fromdisk ? PAGEIN_ELF : PAGEIN_RESIDENT;
+	}
+	else if (as_istext(as, vaddr) || (vaddr >= vbase2 && vaddr < vtop2)) {
+		paddr = getuserframe();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		if (as_istext(as, vaddr)) {
+			result = as_fill_page(as, vaddr, paddr,
+					      as->as_filevaddr1,
+					      as->as_fileoffset1,
+					      as->as_filesize1,
+					      &fromdisk);
+		}
+		else {
+			result = as_fill_page(as, vaddr, paddr,
+					      as->as_filevaddr2,
+					      as->as_fileoffset2,
+					      as->as_filesize2,
+					      &fromdisk);
+		}
+		if (result) {
+			freeuserpage(paddr);
+			return result;
+		}
+		*how = fromdisk ? PAGEIN_ELF : PAGEIN_ZERO;
+	}
+	else if ((mr = as_findmap(as, vaddr)) != NULL) {
+		result = pagecache_getpage(mr->mr_cache,
+					   mr->mr_offset + (vaddr - mr->mr_base),
+					   &paddr, &fromdisk);
+		if (result) {
+			return result;
+		}
+		//the frame stays shared with the cache, so a private
+		//mapping has to copy it before the first write
+		if (!mr->mr_shared) {
+			flags |= PTE_COW;
+		}
+		*how = fromdisk ? PAGEIN_FILE : PAGEIN_RESIDENT;
+	}
+	else {
+		paddr = getuserpage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		*how = PAGEIN_ZERO;
+	}
+
+	spinlock_acquire(&stealmem_lock);
+	*pte = paddr | flags;
+	ownuserpage(paddr, as, vaddr);
+	as_resident_inc(as);
+	return 0;
+}
+
+bool
+vm_tlbrefill(vaddr_t faultaddress, bool iswrite)
+{
+	struct addrspace *as;
+	struct coremap_t *cm;
+	pte_t *pte, entry;
+	uint32_t elo;
+	bool replaced;
+	int spl;
+
+	if (faultaddress >= USERSPACETOP || curproc == NULL) {
+		return false;
+	}
+	//only this thread changes it, so p_lock isn't needed
+	as = curproc->p_addrspace;
+	if (as == NULL || !as->as_loaded) {
+		return false;
+	}
+	faultaddress &= PAGE_FRAME;
+	pte = pt_lookup(as->as_pt, faultaddress);
+	if (pte == NULL) {
+		return false;
+	}
+
+	/*
+	 * No lock: nothing but eviction changes our entries behind our
+	 * back, and it marks an entry busy before shooting the page out
+	 * of every TLB that may have it. So load the entry, then look
+	 * again: if it changed, take ours back out and leave it to
+	 * vm_fault; if not, an eviction starting now will find it.
+	 */
+	entry = *(volatile pte_t *)pte;
+	if ((entry & (PTE_VALID | PTE_BUSY)) != PTE_VALID) {
+		return false;
+	}
+	//the same permissions vm_fault gave it last time; writes to
+	//anything not writable yet need vm_fault to decide
+	elo = PTE_PADDR(entry) | TLBLO_VALID;
+	if ((entry & (PTE_WRITABLE | PTE_COW)) == PTE_WRITABLE &&
+	    !as_istext(as, faultaddress)) {
+		elo |= TLBLO_DIRTY;
+	}
+	else if (iswrite) {
+		return false;
+	}
+
+	//interrupts stay off until we're done, so the shootdown an
+	//eviction sends can't get in before the check
+	spl = splhigh();
+	replaced = tlb_load(faultaddress, elo);
+	if (*(volatile pte_t *)pte != entry) {
+		tlb_invalidate_asid(as->as_asid[curcpu->c_number],
+				    faultaddress);
+		splx(spl);
+		return false;
+	}
+
+	//a race with the clock hand over the bit only costs a lap
+	cm = &coremap[COREMAP_INDEX(PTE_PADDR(entry))];
+	cm->referenced = true;
+	if (cm->refs == 1 && cm->as != as) {
+		//whoever shared it is gone: ours alone now, so evictable
+		spinlock_acquire(&stealmem_lock);
+		if (*pte == entry) {
+			ownuserpage(PTE_PADDR(entry), as, faultaddress);
+		}
+		spinlock_release(&stealmem_lock);
+	}
+	vmstats_refill(replaced);
+	splx(spl);
+	return true;
+}
+
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	vaddr_t vbase1, vtop1, vbase2, vtop2, heaptop, stacktop;
+	paddr_t paddr;
+	pte_t *pte;
+	bool isdata, isheap;
+	int result, how;
+	uint32_t elo;
+	struct addrspace *as;
+	struct mmap_region *mr;
+	bool istext;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = curproc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+
+	/* Assert that the address space has been set up properly. */
+	KASSERT(as->as_pt != NULL);
+	KASSERT(as->as_vbase1 != 0);
+	KASSERT(as->as_npages1 != 0);
+	KASSERT(as->as_vbase2 != 0);
+	KASSERT(as->as_npages2 != 0);
+	KASSERT((as->as_vbase1 & PAGE_FRAME) == as->as_vbase1);
+	KASSERT((as->as_vbase2 & PAGE_FRAME) == as->as_vbase2);
+
+	vbase1 = as->as_vbase1;
+	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	heaptop = ROUNDUP(as->as_heaptop, PAGE_SIZE);
+	stacktop = USERSTACK;
+
+	istext = faultaddress >= vbase1 && faultaddress < vtop1;
+	isdata = faultaddress >= vbase2 && faultaddress < vtop2;
+	isheap = faultaddress >= as->as_heapbase && faultaddress < heaptop;
+	mr = as_findmap(as, faultaddress);
+	if (!istext && !isdata && !isheap && mr == NULL &&
+	    !(faultaddress >= as->as_stackbase && faultaddress < stacktop)) {
+		result = as_grow_stack(as, faultaddress);
+		if (result) {
+			return result;
+		}
+	}
+
+	//mips can't tell reads from instruction fetches, so PROT_EXEC
+	//allows reads and PROT_READ allows execution
+	if (mr != NULL &&
+	    (mr->mr_prot & (PROT_READ | PROT_WRITE | PROT_EXEC)) == 0) {
+		return EFAULT;
+	}
+	if (mr != NULL && faulttype != VM_FAULT_READ &&
+	    !(mr->mr_prot & PROT_WRITE)) {
+		return EFAULT;
+	}
+
+	if (faulttype == VM_FAULT_READONLY && mr != NULL && mr->mr_shared) {
+		//first write to a shared file page since it was mapped here:
+		//it will have to go back to the file
+		pagecache_dirty(mr->mr_cache,
+				mr->mr_offset + (faultaddress - mr->mr_base));
+		pte = pt_lookup(as->as_pt, faultaddress);
+		KASSERT(pte != NULL);
+		spinlock_acquire(&stealmem_lock);
+		KASSERT(*pte & PTE_VALID);
+		*pte |= PTE_WRITABLE;
+		tlb_update(faultaddress,
+			   PTE_PADDR(*pte) | TLBLO_DIRTY | TLBLO_VALID);
+		spinlock_release(&stealmem_lock);
+		return 0;
+	}
+
+	if (faulttype == VM_FAULT_READONLY) {
+		//the only legal write to a read-only page is to a copy-on-write one
+		pte = pt_lookup(as->as_pt, faultaddress);
+		if (pte == NULL) {
+			return EPERM;
+		}
+		spinlock_acquire(&stealmem_lock);
+		while (*pte & PTE_BUSY) {
+			vm_wait_busy();
+		}
+		if (!(*pte & PTE_VALID) || !(*pte & PTE_COW)) {
+			spinlock_release(&stealmem_lock);
+			//if it was evicted meanwhile, let the refault sort it out
+			return (*pte & PTE_SWAPPED) ? 0 : EPERM;
+		}
+		result = as_break_cow(as, faultaddress, pte);
+		if (!result) {
+			as->as_faults++;
+			*pte |= PTE_WRITABLE;
+			tlb_update(faultaddress,
+				   PTE_PADDR(*pte) | TLBLO_DIRTY | TLBLO_VALID);
+		}
+		spinlock_release(&stealmem_lock);
+		return result;
+	}
+
+	pte = pt_lookup_alloc(as->as_pt, faultaddress);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&stealmem_lock);
+	result = as_pagein(as, faultaddress, pte, &how);
+	if (result) {
+		return result;
+	}
+
+	//a write to a shared page may as well get its copy right away
+	if (faulttype == VM_FAULT_WRITE && (*pte & PTE_COW)) {
+		result = as_break_cow(as, faultaddress, pte);
+		if (result) {
+			spinlock_release(&stealmem_lock);
+			return result;
+		}
+	}
+	paddr = PTE_PADDR(*pte);
+
+	switch (how) {
+	    case PAGEIN_RESIDENT:
+		vmstats_inc(VMSTAT_TLB_RELOAD);
+		break;
+	    case PAGEIN_ZERO:
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+		break;
+	    case PAGEIN_ELF:
+		vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+		vmstats_inc(VMSTAT_ELF_FILE_READ);
+		break;
+	    case PAGEIN_SWAP:
+		vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+		vmstats_inc(VMSTAT_SWAP_FILE_READ);
+		break;
+	    case PAGEIN_FILE:
+		vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+		vmstats_inc(VMSTAT_MAPPED_FILE_READ);
+		break;
+	}
+	if (how != PAGEIN_RESIDENT) {
+		as->as_faults++;
+	}
+
+	/* make sure it's page-aligned */
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+
+	//text is read-only once loadelf has completed, and shared
+	//pages stay read-only until somebody writes to them
+	if ((as->as_loaded && istext) || (*pte & PTE_COW)) {
+		elo &= ~TLBLO_DIRTY;
+	}
+	//shared file pages stay read-only until the first write marks
+	//them dirty in the cache
+	if (mr != NULL && mr->mr_shared && faulttype != VM_FAULT_WRITE) {
+		elo &= ~TLBLO_DIRTY;
 	}
-	// the addr hasn't been found or wrong pointer
-	if(i == total_frames || wrongpointer){
-		panic("wrong pointer to free!\n");
+	//and mappings without PROT_WRITE stay read-only for good
+	if (mr != NULL && !(mr->mr_prot & PROT_WRITE)) {
+		elo &= ~TLBLO_DIRTY;
 	}
-	
-	spinlock_release(&stealmem_lock);
 
-#else
+	//let vm_tlbrefill reload it the same way next time
+	if (elo & TLBLO_DIRTY) {
+		*pte |= PTE_WRITABLE;
+	}
 
-	/* nothing - leak the memory. */
+	//only now is the fault serviced and worth counting
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	vmstats_inc(VMSTAT_TLB_SLOWPATH);
 
-	(void)addr;
-	
-#endif //OPT_A3 
-}
+	//still under the lock, so an eviction can't slip in between
+	//checking the entry and loading it
+	DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
+	tlb_install(faultaddress, elo);
+	spinlock_release(&stealmem_lock);
 
-void
-vm_tlbshootdown_all(void)
-{
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	//our mapping keeps the page in the cache, so this can wait until
+	//the lock is gone; the write itself only happens once we return
+	if (mr != NULL && mr->mr_shared && faulttype == VM_FAULT_WRITE) {
+		pagecache_dirty(mr->mr_cache,
+				mr->mr_offset + (faultaddress - mr->mr_base));
+	}
+	return 0;
 }
 
-void
-vm_tlbshootdown(const struct tlbshootdown *ts)
-{
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
-}
+#else
 
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
@@ -244,13 +1737,6 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-	    	
-#if OPT_A3
-
-		return EPERM;
-
-#endif //OPT_A3
-
 		/* We always create pages read-write, so we can't get this */
 		panic("dumbvm: got VM_FAULT_READONLY\n");
 	    case VM_FAULT_READ:
@@ -325,45 +1811,19 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		}
 		ehi = faultaddress;
 		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-
-#if OPT_A3
-
-		//set text segment READ_ONLY when loadelf has completed and faultaddress is in text segment
-		if (as->as_loaded  && (faultaddress >= vbase1 && faultaddress < vtop1)) {
-			elo &= ~TLBLO_DIRTY;
-		}
-
-#endif //OPT_A3
-
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
 		return 0;
 	}
 
-#if OPT_A3
-	
-	ehi = faultaddress;
-	elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-	
-	if ((as->as_loaded) && (faultaddress >= vbase1 && faultaddress < vtop1)) {
-		elo &= ~TLBLO_DIRTY;
-	}
-	
-	//write a TLB entry randomly when there is not an invalid entry in TLB slot
-	tlb_random(ehi, elo);
-	splx(spl);
-	return 0;
-
-#else
-
 	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
 	splx(spl);
 	return EFAULT;
-	
-#endif //OPT_A3
 }
 
+#endif //OPT_A3
+
 struct addrspace *
 as_create(void)
 {
@@ -372,6 +1832,41 @@ as_create(void)
 		return NULL;
 	}
 
+#if OPT_A3
+
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->as_vbase1 = 0;
+	as->as_npages1 = 0;
+	as->as_vbase2 = 0;
+	as->as_npages2 = 0;
+	as->as_loaded = false;
+	as->as_vnode = NULL;
+	as->as_filevaddr1 = 0;
+	as->as_fileoffset1 = 0;
+	as->as_filesize1 = 0;
+	as->as_filevaddr2 = 0;
+	as->as_fileoffset2 = 0;
+	as->as_filesize2 = 0;
+	as->as_textcache = NULL;
+	as->as_heapbase = 0;
+	as->as_heaptop = 0;
+	as->as_stackbase = USERSTACK - PAGE_SIZE;
+	as->as_stacklimit = STACK_RLIMIT;
+	as->as_maps = NULL;
+	as->as_resident = 0;
+	as->as_maxresident = 0;
+	as->as_faults = 0;
+	gettime(&as->as_created, &as->as_creatednsec);
+	for (int i = 0; i < MAXCPUS; i++) {
+		as->as_asid[i] = 0;
+	}
+
+#else
+
 	as->as_vbase1 = 0;
 	as->as_pbase1 = 0;
 	as->as_npages1 = 0;
@@ -379,22 +1874,107 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;	
-#if OPT_A3
-	as->as_loaded = false;
+
 #endif //OPT_A3
 
 	return as;
 }
 
+#if OPT_A3
+
+//pt_walk callback: give back the frame or swap slot behind one page of
+//the address space DATA
+static
+int
+as_free_page(vaddr_t vaddr, pte_t *pte, void *data)
+{
+	struct addrspace *as = data;
+	paddr_t pa;
+	unsigned slot;
+
+	(void)vaddr;
+
+	spinlock_acquire(&stealmem_lock);
+	while (*pte & PTE_BUSY) {
+		vm_wait_busy();
+	}
+	if (*pte & PTE_VALID) {
+		pa = PTE_PADDR(*pte);
+		*pte = 0;
+		//no longer ours for the evictor to find
+		coremap[COREMAP_INDEX(pa)].as = NULL;
+		as_resident_dec(as);
+		spinlock_release(&stealmem_lock);
+		freeuserpage(pa);
+	}
+	else if (*pte & PTE_SWAPPED) {
+		slot = PTE_SLOT(*pte);
+		*pte = 0;
+		spinlock_release(&stealmem_lock);
+		swap_free(slot);
+	}
+	else {
+		spinlock_release(&stealmem_lock);
+	}
+	return 0;
+}
+
+/*
+ * Take MR out of AS and free it, dropping whatever pages of it are
+ * mapped. Changes made through a shared mapping are written back.
+ */
+static
+int
+as_unmap_region(struct addrspace *as, struct mmap_region *mr)
+{
+	struct mmap_region **pp;
+	vaddr_t va;
+	pte_t *pte;
+	int result;
+
+	for (pp = &as->as_maps; *pp != mr; pp = &(*pp)->mr_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = mr->mr_next;
+
+	for (va = mr->mr_base; va < mr->mr_base + mr->mr_npages * PAGE_SIZE;
+	     va += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, va);
+		if (pte != NULL && *pte != 0) {
+			tlb_invalidate(as, va);
+			as_free_page(va, pte, as);
+		}
+	}
+	as_tlb_forget(as, false);
+
+	result = 0;
+	if (mr->mr_shared && (mr->mr_prot & PROT_WRITE)) {
+		result = pagecache_sync(mr->mr_cache);
+	}
+	pagecache_release(mr->mr_cache);
+	kfree(mr);
+	return result;
+}
+
+#endif //OPT_A3
+
 void
 as_destroy(struct addrspace *as)
 {
 	
 #if OPT_A3
 
-	kfree((void *)PADDR_TO_KVADDR(as->as_pbase1));
-	kfree((void *)PADDR_TO_KVADDR(as->as_pbase2));
-	kfree((void *)PADDR_TO_KVADDR(as->as_stackpbase));
+	while (as->as_maps != NULL) {
+		as_unmap_region(as, as->as_maps);
+	}
+	pt_walk(as->as_pt, as_free_page, as);
+	pt_destroy(as->as_pt);
+	if (as->as_textcache != NULL) {
+		pagecache_release(as->as_textcache);
+	}
+	if (as->as_vnode != NULL) {
+		vfs_close(as->as_vnode);
+	}
 
 #endif //OPT_A3
 
@@ -404,7 +1984,10 @@ as_destroy(struct addrspace *as)
 void
 as_activate(void)
 {
-	int i, spl;
+#if !OPT_A3
+	int i;
+#endif
+	int spl;
 	struct addrspace *as;
 
 	as = curproc_getas();
@@ -418,9 +2001,15 @@ as_activate(void)
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
+#if OPT_A3
+	//switch to its address space id; its old entries stay usable
+	asid_current[curcpu->c_number] = as_getasid(as);
+	tlb_restoreasid();
+#else
 	for (i=0; i<NUM_TLB; i++) {
 		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
 	}
+#endif //OPT_A3
 
 	splx(spl);
 }
@@ -446,6 +2035,14 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 	npages = sz / PAGE_SIZE;
 
+#if OPT_A3
+	//nothing gets uiomoved at load time any more, so nothing catches
+	//an executable that tries to load itself into kernel space
+	if (vaddr >= USERSPACETOP || sz > USERSPACETOP - vaddr) {
+		return EFAULT;
+	}
+#endif //OPT_A3
+
 	/* We don't use these - all pages are read-write */
 	(void)readable;
 	(void)writeable;
@@ -470,6 +2067,18 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	return EUNIMP;
 }
 
+#if OPT_A3
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	//nothing to reserve up front: every page gets its own frame on first touch
+	KASSERT(as->as_pt != NULL);
+	return 0;
+}
+
+#else
+
 static
 void
 as_zero_region(paddr_t paddr, unsigned npages)
@@ -506,12 +2115,20 @@ as_prepare_load(struct addrspace *as)
 	return 0;
 }
 
+#endif //OPT_A3
+
 int
 as_complete_load(struct addrspace *as)
 {
 
 #if OPT_A3
 
+	//the heap starts out empty, on the page after the highest region
+	as->as_heapbase = as->as_vbase2 + as->as_npages2 * PAGE_SIZE;
+	if (as->as_vbase1 + as->as_npages1 * PAGE_SIZE > as->as_heapbase) {
+		as->as_heapbase = as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
+	}
+	as->as_heaptop = as->as_heapbase;
 	as->as_loaded = true;
 	as_activate();
 
@@ -527,12 +2144,309 @@ as_complete_load(struct addrspace *as)
 int
 as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
+#if OPT_A3
+	KASSERT(as->as_pt != NULL);
+#else
 	KASSERT(as->as_stackpbase != 0);
+#endif //OPT_A3
 
 	*stackptr = USERSTACK;
 	return 0;
 }
 
+#if OPT_A3
+
+int
+as_define_file(struct addrspace *as, struct vnode *v,
+	       vaddr_t vaddr, size_t filesize, off_t offset)
+{
+	vaddr_t vbase = vaddr & PAGE_FRAME;
+
+	if (vbase == as->as_vbase1) {
+		as->as_filevaddr1 = vaddr;
+		as->as_fileoffset1 = offset;
+		as->as_filesize1 = filesize;
+		//whole file pages can be shared if they line up with ours;
+		//without a cache, text is just read in privately
+		if (as->as_textcache == NULL &&
+		    (offset - vaddr) % PAGE_SIZE == 0) {
+			as->as_textcache = pagecache_get(v);
+		}
+	}
+	else if (vbase == as->as_vbase2) {
+		as->as_filevaddr2 = vaddr;
+		as->as_fileoffset2 = offset;
+		as->as_filesize2 = filesize;
+	}
+	else {
+		return EINVAL;
+	}
+
+	//hold the executable open for as long as pages may still come from it
+	if (as->as_vnode == NULL) {
+		VOP_INCOPEN(v);
+		VOP_INCREF(v);
+		as->as_vnode = v;
+	}
+	KASSERT(as->as_vnode == v);
+	return 0;
+}
+
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldtop)
+{
+	vaddr_t old, new, va, limit;
+	struct mmap_region *mr;
+	pte_t *pte;
+
+	old = as->as_heaptop;
+	new = old + amount;
+
+	if (amount < 0 && (new > old || new < as->as_heapbase)) {
+		return EINVAL;
+	}
+	//keep clear of everything the stack may still grow into
+	limit = USERSTACK - as->as_stacklimit - PAGE_SIZE;
+	if (as->as_stackbase - PAGE_SIZE < limit) {
+		limit = as->as_stackbase - PAGE_SIZE;
+	}
+	//and of the lowest mapping
+	for (mr = as->as_maps; mr != NULL; mr = mr->mr_next) {
+		if (mr->mr_base - PAGE_SIZE < limit) {
+			limit = mr->mr_base - PAGE_SIZE;
+		}
+	}
+	if (amount > 0 && (new < old || ROUNDUP(new, PAGE_SIZE) > limit)) {
+		return ENOMEM;
+	}
+
+	//growing costs nothing until the pages are touched; shrinking
+	//gives back whatever was faulted in above the new break
+	for (va = ROUNDUP(new, PAGE_SIZE); va < ROUNDUP(old, PAGE_SIZE);
+	     va += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, va);
+		if (pte != NULL && *pte != 0) {
+			tlb_invalidate(as, va);
+			as_free_page(va, pte, as);
+		}
+	}
+	if (new < old) {
+		as_tlb_forget(as, false);
+	}
+
+	as->as_heaptop = new;
+	*oldtop = old;
+	return 0;
+}
+
+int
+as_mmap(struct addrspace *as, struct vnode *v, size_t len, int prot,
+	bool shared, off_t offset, vaddr_t *ret)
+{
+	struct mmap_region *mr, *newmr, **pp;
+	vaddr_t top, bottom;
+	size_t size;
+
+	if (len == 0 || offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	size = ROUNDUP(len, PAGE_SIZE);
+	//the page cache indexes pages by 32-bit offset
+	if (size < len || offset + size > 0x100000000LL) {
+		return EINVAL;
+	}
+
+	//first fit, from just below the stack's space down to the heap,
+	//leaving a guard page above the heap
+	top = USERSTACK - as->as_stacklimit - PAGE_SIZE;
+	bottom = ROUNDUP(as->as_heaptop, PAGE_SIZE) + PAGE_SIZE;
+	for (pp = &as->as_maps; ; pp = &(*pp)->mr_next) {
+		mr = *pp;
+		if (mr == NULL ||
+		    top - (mr->mr_base + mr->mr_npages * PAGE_SIZE) >= size) {
+			break;
+		}
+		top = mr->mr_base;
+	}
+	if (top < bottom || top - bottom < size) {
+		return ENOMEM;
+	}
+
+	newmr = kmalloc(sizeof(struct mmap_region));
+	if (newmr == NULL) {
+		return ENOMEM;
+	}
+	newmr->mr_cache = pagecache_get(v);
+	if (newmr->mr_cache == NULL) {
+		kfree(newmr);
+		return ENOMEM;
+	}
+	newmr->mr_base = top - size;
+	newmr->mr_npages = size / PAGE_SIZE;
+	newmr->mr_offset = offset;
+	newmr->mr_prot = prot;
+	newmr->mr_shared = shared;
+	newmr->mr_next = mr;
+	*pp = newmr;
+
+	*ret = newmr->mr_base;
+	return 0;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t vaddr, size_t len)
+{
+	struct mmap_region *mr;
+
+	mr = as_findmap(as, vaddr);
+	if (mr == NULL || mr->mr_base != vaddr ||
+	    ROUNDUP(len, PAGE_SIZE) != mr->mr_npages * PAGE_SIZE) {
+		return EINVAL;
+	}
+	return as_unmap_region(as, mr);
+}
+
+void
+as_exitstats(struct addrspace *as, const char *name)
+{
+	time_t secs;
+	uint32_t nsecs;
+	unsigned msecs;
+
+	gettime(&secs, &nsecs);
+	if (nsecs < as->as_creatednsec) {
+		secs--;
+		nsecs += 1000000000;
+	}
+	msecs = (secs - as->as_created) * 1000 +
+		(nsecs - as->as_creatednsec) / 1000000;
+	vmstats_proc(name, as->as_maxresident, as->as_faults, msecs);
+}
+
+#endif //OPT_A3
+
+#if OPT_A3
+
+struct as_copy_args {
+	struct addrspace *old;
+	struct addrspace *new;
+};
+
+/*
+ * pt_walk callback: map one of the parent's pages into the new address
+ * space too. Text is never writable and shared file mappings are meant
+ * to be shared, so those pages simply are; other pages are marked
+ * copy-on-write in both. Pages the parent has out in
+ * swap are brought back first.
+ */
+static
+int
+as_share_page(vaddr_t vaddr, pte_t *pte, void *data)
+{
+	struct as_copy_args *args = data;
+	struct mmap_region *mr;
+	pte_t *newpte;
+	int result, how;
+
+	newpte = pt_lookup_alloc(args->new->as_pt, vaddr);
+	if (newpte == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&stealmem_lock);
+	result = as_pagein(args->old, vaddr, pte, &how);
+	if (result) {
+		return result;
+	}
+
+	mr = as_findmap(args->new, vaddr);
+	if (!as_istext(args->new, vaddr) && !(mr != NULL && mr->mr_shared)) {
+		//a writable entry left here would write straight past the copy
+		if (!(*pte & PTE_COW)) {
+			tlb_invalidate(args->old, vaddr);
+		}
+		*pte |= PTE_COW;
+	}
+	shareuserpage(PTE_PADDR(*pte));
+	*newpte = *pte;
+	as_resident_inc(args->new);
+	spinlock_release(&stealmem_lock);
+	return 0;
+}
+
+int
+as_copy(struct addrspace *old, struct addrspace **ret)
+{
+	struct addrspace *new;
+	struct as_copy_args args;
+	struct mmap_region *mr, *newmr, **tail;
+	int result;
+
+	new = as_create();
+	if (new==NULL) {
+		return ENOMEM;
+	}
+
+	new->as_vbase1 = old->as_vbase1;
+	new->as_npages1 = old->as_npages1;
+	new->as_vbase2 = old->as_vbase2;
+	new->as_npages2 = old->as_npages2;
+	new->as_loaded = old->as_loaded;
+	new->as_filevaddr1 = old->as_filevaddr1;
+	new->as_fileoffset1 = old->as_fileoffset1;
+	new->as_filesize1 = old->as_filesize1;
+	new->as_filevaddr2 = old->as_filevaddr2;
+	new->as_fileoffset2 = old->as_fileoffset2;
+	new->as_filesize2 = old->as_filesize2;
+	if (old->as_textcache != NULL) {
+		pagecache_ref(old->as_textcache);
+		new->as_textcache = old->as_textcache;
+	}
+	new->as_heapbase = old->as_heapbase;
+	new->as_heaptop = old->as_heaptop;
+	new->as_stackbase = old->as_stackbase;
+	new->as_stacklimit = old->as_stacklimit;
+	//pages the parent never touched still have to come from the file
+	if (old->as_vnode != NULL) {
+		VOP_INCOPEN(old->as_vnode);
+		VOP_INCREF(old->as_vnode);
+		new->as_vnode = old->as_vnode;
+	}
+	//mappings first, so as_share_page can tell shared ones apart
+	tail = &new->as_maps;
+	for (mr = old->as_maps; mr != NULL; mr = mr->mr_next) {
+		newmr = kmalloc(sizeof(struct mmap_region));
+		if (newmr == NULL) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		*newmr = *mr;
+		newmr->mr_next = NULL;
+		pagecache_ref(newmr->mr_cache);
+		*tail = newmr;
+		tail = &newmr->mr_next;
+	}
+
+	//nothing is copied until one side writes to it
+	args.old = old;
+	args.new = new;
+	result = pt_walk(old->as_pt, as_share_page, &args);
+
+	//as_share_page dropped the parent's entries here; other cpus it ran
+	//on before may still have writable ones. it keeps its id on this cpu
+	as_tlb_forget(old, false);
+
+	if (result) {
+		as_destroy(new);
+		return result;
+	}
+
+	*ret = new;
+	return 0;
+}
+
+#else
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -574,3 +2488,4 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	return 0;
 }
 
+#endif //OPT_A3
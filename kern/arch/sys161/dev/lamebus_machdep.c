@@ -41,6 +41,9 @@
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include "autoconf.h"
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 /*
  * CPU frequency used by the on-chip timer.
@@ -73,6 +76,26 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+#if OPT_A3
+/*
+ * Read c0_count ($9), which the timer resets when it matches c0_compare.
+ */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+#endif //OPT_A3
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -242,6 +265,19 @@ mainbus_send_ipi(struct cpu *target)
 	lamebus_assert_ipi(lamebus, target);
 }
 
+#if OPT_A3
+/*
+ * Push the next timer interrupt on this cpu out to NTICKS hardclock
+ * periods from now. The interrupt handler sets the usual period again.
+ */
+void
+mainbus_timer_defer(unsigned nticks)
+{
+	KASSERT(nticks > 0);
+	mips_timer_set(mips_timer_count() + CPU_FREQUENCY / HZ * nticks);
+}
+#endif //OPT_A3
+
 /*
  * Interrupt dispatcher.
  */
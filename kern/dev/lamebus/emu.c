@@ -53,6 +53,9 @@
 #include <vfs.h>
 #include <emufs.h>
 #include "autoconf.h"
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 /* Register offsets */
 #define REG_HANDLE    0
@@ -843,7 +846,12 @@ int
 emufs_mmap(struct vnode *v)
 {
 	(void)v;
+#if OPT_A3
+	//mapped files are paged through VOP_READ and VOP_WRITE
+	return 0;
+#else
 	return EUNIMP;
+#endif //OPT_A3
 }
 
 //////////////////////////////
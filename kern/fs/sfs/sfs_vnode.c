@@ -44,6 +44,9 @@
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
@@ -1117,7 +1120,13 @@ int
 sfs_mmap(struct vnode *v   /* add stuff as needed */)
 {
 	(void)v;
+#if OPT_A3
+	//the VM system pages mapped files in and out with VOP_READ and
+	//VOP_WRITE, so any regular file can be mapped
+	return 0;
+#else
 	return EUNIMP;
+#endif //OPT_A3
 }
 
 /*
@@ -38,8 +38,36 @@
 #include <vm.h>
 //ASST3
 #include "opt-A3.h"
+#include <platform/maxcpus.h>
 //ASST3
 struct vnode;
+#if OPT_A3
+struct pagetable;
+struct pagecache;
+
+/*
+ * The user stack starts out one page long and grows down on faults
+ * close below its bottom, as far as the stack limit allows. New
+ * processes get STACK_RLIMIT; children inherit their parent's.
+ */
+#define STACK_RLIMIT       (2 * 1024 * 1024)
+#define STACK_GROWWINDOW   (16 * PAGE_SIZE)	/* how far below is "close" */
+
+/*
+ * One mmap()ed range of a file. Mappings are placed just below the
+ * space reserved for the stack, working down towards the heap, and
+ * are kept in a list from the highest down.
+ */
+struct mmap_region {
+  vaddr_t mr_base;
+  size_t mr_npages;
+  off_t mr_offset;		/* file offset of mr_base */
+  int mr_prot;			/* PROT_ flags */
+  bool mr_shared;		/* MAP_SHARED rather than MAP_PRIVATE */
+  struct pagecache *mr_cache;	/* the file's pages */
+  struct mmap_region *mr_next;
+};
+#endif //OPT_A3
 
 
 /* 
@@ -50,6 +78,38 @@ struct vnode;
  */
 
 struct addrspace {
+#if OPT_A3
+  vaddr_t as_vbase1;
+  size_t as_npages1;
+  vaddr_t as_vbase2;
+  size_t as_npages2;
+  struct pagetable *as_pt;	/* frames are allocated one at a time */
+  bool as_loaded;
+  /* where each region's initialized data lives in the executable */
+  struct vnode *as_vnode;
+  vaddr_t as_filevaddr1;
+  off_t as_fileoffset1;
+  size_t as_filesize1;
+  vaddr_t as_filevaddr2;
+  off_t as_fileoffset2;
+  size_t as_filesize2;
+  struct pagecache *as_textcache;	/* text pages shared by all users of
+					   the executable, or NULL */
+  vaddr_t as_heapbase;		/* heap starts on the page after the data */
+  vaddr_t as_heaptop;		/* current break */
+  vaddr_t as_stackbase;		/* lowest stack page so far */
+  size_t as_stacklimit;		/* how far below USERSTACK it may grow */
+  struct mmap_region *as_maps;	/* highest first */
+  /* working set: resident pages (shared ones count for each user),
+     and page faults, counting copy-on-write copies */
+  unsigned as_resident;
+  unsigned as_maxresident;
+  unsigned as_faults;
+  time_t as_created;
+  uint32_t as_creatednsec;
+  /* per cpu: TLB address space id and its generation, 0 if none yet */
+  uint32_t as_asid[MAXCPUS];
+#else
   vaddr_t as_vbase1;
   paddr_t as_pbase1;
   size_t as_npages1;
@@ -57,8 +117,6 @@ struct addrspace {
   paddr_t as_pbase2;
   size_t as_npages2;
   paddr_t as_stackpbase;
-#if OPT_A3
-  bool as_loaded;
 #endif //OPT_A3
 };
 
@@ -96,6 +154,34 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_file - record that FILESIZE bytes at VADDR come from
+ *                offset OFFSET of the executable V, so the pages can
+ *                be read in by vm_fault when first touched instead of
+ *                at exec time. The region must already be defined.
+ *                The address space keeps V open until it's destroyed.
+ *                Text is taken from V's page cache when the file lays
+ *                it out page by page as in memory, so every process
+ *                running the same program shares one copy.
+ *
+ *    as_sbrk   - move the end of the heap by AMOUNT bytes, which may be
+ *                negative, and hand back the old end. Heap pages are
+ *                zero-filled when first touched; pages given back are
+ *                freed at once. Returns EINVAL if the heap would end
+ *                below where it started, ENOMEM if it would run into
+ *                the space reserved for the stack.
+ *
+ *    as_mmap   - map LEN bytes of V from page-aligned OFFSET somewhere
+ *                between the heap and the stack, and hand back where.
+ *                Pages come from V's page cache when first touched.
+ *                Shared mappings see, and write back to, the file;
+ *                private ones copy a page the first time it's written.
+ *
+ *    as_munmap - remove the mapping that starts at VADDR, which must
+ *                be LEN bytes long, writing back what it changed.
+ *
+ *    as_exitstats - record the working set statistics of AS, which
+ *                belongs to the exiting process NAME, for vmstats_print.
  */
 
 struct addrspace *as_create(void);
@@ -112,6 +198,19 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+#if OPT_A3
+int               as_define_file(struct addrspace *as, struct vnode *v,
+                                 vaddr_t vaddr, size_t filesize,
+                                 off_t offset);
+int               as_sbrk(struct addrspace *as, intptr_t amount,
+                          vaddr_t *oldtop);
+int               as_mmap(struct addrspace *as, struct vnode *v,
+                          size_t len, int prot, bool shared,
+                          off_t offset, vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t vaddr,
+                            size_t len);
+void              as_exitstats(struct addrspace *as, const char *name);
+#endif //OPT_A3
 
 
 /*
@@ -31,6 +31,10 @@
 #define _CLOCK_H_
 
 #include "opt-synchprobs.h"
+//ASST3
+#include "opt-A3.h"
+#include <spinlock.h>
+//ASST3
 
 /*
  * Time-related definitions.
@@ -72,6 +76,7 @@ void getinterval(time_t secs1, uint32_t nsecs,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
  *
  *  this will be more efficient than clocknap() for longer sleeps
+ *  (under OPT_A3 both wake the sleeper once, at its deadline)
  */
 void clocksleep(int seconds);
 
@@ -83,5 +88,32 @@ void clocksleep(int seconds);
  */
 void clocknap(int ticks);
 
+#if OPT_A3
+/*
+ * A cpu's timed sleepers, in order of deadline. Set up by timerq_init,
+ * from cpu_create.
+ */
+struct timeout;	/* private to clock.c */
+struct wchan;	/* from <wchan.h> */
+struct timerq {
+	struct spinlock tq_lock;
+	struct timeout *tq_head;
+	struct wchan *tq_wchan;
+	bool tq_deferred;		/* hardclocks put off while idle */
+	uint32_t tq_idlestart;		/* timerclock ticks then */
+	unsigned tq_idlehardclocks;	/* c_hardclocks then */
+};
+
+void timerq_init(struct timerq *tq);
+
+/*
+ * hardclock_idle() lets an idle cpu skip hardclocks until its next
+ * timed sleeper is due; hardclock_unidle() puts them back once it has
+ * work. Both are called from the idle loop with interrupts off.
+ */
+void hardclock_idle(void);
+void hardclock_unidle(void);
+#endif //OPT_A3
+
 
 #endif /* _CLOCK_H_ */
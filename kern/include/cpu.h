@@ -34,6 +34,10 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+//ASST3
+#include "opt-A3.h"
+#include <clock.h>
+//ASST3
 
 
 /*
@@ -60,6 +64,22 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+#if OPT_A3
+	/*
+	 * Decayed average of the run queue length, in fixed point (see
+	 * thread_update_load). Other cpus read it without locking, as a
+	 * hint of where to steal work from.
+	 */
+	volatile unsigned c_loadavg;
+	/* where wakeups done on this cpu put the threads woken */
+	unsigned c_wake_last;		/* their last cpu, since it was idle */
+	unsigned c_wake_idle;		/* some other idle cpu */
+	unsigned c_wake_least;		/* the cpu with the shortest queue */
+	/* switched away from; not allowed here, so to be placed elsewhere */
+	struct thread *c_migrant;
+	struct thread *c_idlethread;	/* runs only to send c_migrant off */
+	struct timerq c_timerq;		/* timed sleepers, see clock.c */
+#endif //OPT_A3
 
 	/*
 	 * Accessed by other cpus.
@@ -86,6 +106,9 @@ struct cpu {
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+#if OPT_A3
+	volatile unsigned c_shootdown_gen; /* shootdown batches handled */
+#endif //OPT_A3
 	struct spinlock c_ipi_lock;
 };
 
@@ -152,6 +175,11 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_post queues TLB shootdown data for another CPU
+ * without sending anything, so that several invalidations can go in one
+ * IPI; it may be called with spinlocks held. ipi_tlbshootdown_wait then
+ * interrupts each CPU in a bitmask of CPU numbers that still has data
+ * queued and waits until every one of them has acted on it.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +194,11 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+#if OPT_A3
+void ipi_tlbshootdown_post(unsigned cpunum,
+			   const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_wait(uint32_t targets);
+#endif //OPT_A3
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,22 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap() and munmap(), shared between the kernel and
+ * <sys/mman.h> in userland.
+ */
+
+/* Page protection: any combination of these */
+#define PROT_NONE     0
+#define PROT_READ     1      /* Pages may be read */
+#define PROT_WRITE    2      /* Pages may be written */
+#define PROT_EXEC     4      /* Pages may be executed */
+
+/* Sharing: exactly one of these */
+#define MAP_SHARED    1      /* Writes go to the file and are seen by all */
+#define MAP_PRIVATE   2      /* Writes go to a private copy */
+
+/* What mmap returns when it fails */
+#define MAP_FAILED    ((void *)-1)
+
+#endif /* _KERN_MMAN_H_ */
@@ -196,6 +196,8 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (scheduling)
+#define SYS_setaffinity  121
 
 /*CALLEND*/
 
@@ -0,0 +1,41 @@
+#ifndef _KMEM_CACHE_H_
+#define _KMEM_CACHE_H_
+
+/*
+ * Object caches for kernel structures that are created and destroyed
+ * all the time (threads, procs, synchronization primitives...).
+ *
+ * A cache hands out objects of one size that its constructor has
+ * already set up, and takes them back in that same state: the user
+ * undoes only what it changed, and the next kmem_cache_alloc skips
+ * both the allocation and the setup. Objects live on slabs of one page
+ * each. A slab that falls completely free is kept if it's the cache's
+ * only empty one; otherwise it's given back, and the destructor is run
+ * on each of its objects.
+ *
+ * Functions:
+ *       kmem_cache_create - make a cache called NAME (a string constant)
+ *                           of SIZE-byte objects. CTOR, if not NULL,
+ *                           sets up a fresh object and returns an error
+ *                           code if it can't; DTOR, if not NULL, undoes
+ *                           that. Caches are made at boot and never
+ *                           destroyed, so running out of memory here
+ *                           panics.
+ *       kmem_cache_alloc  - return a constructed object, or NULL if out
+ *                           of memory.
+ *       kmem_cache_free   - give an object back, still constructed.
+ *       kmem_cache_printstats - print how much each cache is using.
+ *
+ * kmem_cache_alloc may sleep wherever kmalloc may.
+ */
+
+struct kmem_cache;
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     int (*ctor)(void *obj),
+				     void (*dtor)(void *obj));
+void *kmem_cache_alloc(struct kmem_cache *kc);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+void kmem_cache_printstats(void);
+
+#endif /* _KMEM_CACHE_H_ */
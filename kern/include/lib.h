@@ -58,6 +58,7 @@
  * temporarily instead.
  */
 #include "opt-noasserts.h"
+#include "opt-kmallocprof.h"
 
 #if OPT_NOASSERTS
 #define KASSERT(expr) ((void)(expr))
@@ -127,6 +128,19 @@ void *kmalloc(size_t size);
 void kfree(void *ptr);
 void kheap_printstats(void);
 
+/*
+ * With the kernel config option "kmallocprof", every kmalloc is charged
+ * to the file and line it was called from, and kfree gives the bytes
+ * back; kmalloc_printprofile (menu command kp) lists the callsites
+ * holding the most memory. Without the option this is all compiled
+ * out and kmalloc is called directly.
+ */
+#if OPT_KMALLOCPROF
+void *kmalloc_prof(size_t size, const char *file, int line);
+void kmalloc_printprofile(void);
+#define kmalloc(size) kmalloc_prof((size), __FILE__, __LINE__)
+#endif
+
 /*
  * C string functions. 
  *
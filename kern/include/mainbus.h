@@ -30,6 +30,10 @@
 #ifndef _MAINBUS_H_
 #define _MAINBUS_H_
 
+//ASST3
+#include "opt-A3.h"
+//ASST3
+
 /*
  * Abstract system bus interface.
  */
@@ -55,6 +59,14 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+#if OPT_A3
+/*
+ * Make this cpu's next hardclock come NTICKS hardclock periods from
+ * now. After that the timer goes back to HZ.
+ */
+void mainbus_timer_defer(unsigned nticks);
+#endif //OPT_A3
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
@@ -0,0 +1,83 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/*
+ * Per-vnode cache of file pages, for memory-mapped files and for the
+ * text of running programs.
+ *
+ * Every vnode that is mapped somewhere has one page cache, shared by
+ * all its mappings, which holds the frames its pages have been read
+ * into. The frames are ordinary reference-counted user frames: the
+ * cache holds one reference and each page table mapping the page holds
+ * another, so a page stays put for as long as anybody maps it and all
+ * of them see the same memory.
+ *
+ * Pages written through a shared mapping are marked dirty and written
+ * back to the file by pagecache_sync and when the last reference to
+ * the cache goes away. Nothing is ever written past the end of the
+ * file. Since writes don't fault once a page is writable, a page stays
+ * dirty until nobody uses the cache.
+ *
+ * A cache nobody uses is kept, with its pages, on an LRU list, so that
+ * a program run again and again finds its text already in memory. Any
+ * clean page nobody maps may be taken back by the eviction clock; a
+ * cache it has emptied is freed the next time a cache is created, and
+ * every unused one is when memory for a new cache runs out.
+ *
+ * Functions:
+ *       pagecache_bootstrap - set up the table of caches.
+ *       pagecache_get   - return V's cache, creating it if need be, with
+ *                         a reference for the caller. Returns NULL on
+ *                         out-of-memory.
+ *       pagecache_find  - same, but NULL if V has no cache.
+ *       pagecache_ref   - take another reference.
+ *       pagecache_release - drop a reference; the last one writes back
+ *                         the pages and leaves the cache unused.
+ *       pagecache_shutdown - free every unused cache, letting go of
+ *                         their vnodes.
+ *       pagecache_getpage - make the page at OFFSET resident and return
+ *                         its frame with a new reference, which the
+ *                         caller puts in a page table and later drops
+ *                         with free_upage. *FROMDISK says whether it had
+ *                         to be read in.
+ *       pagecache_dirty - note that the page at OFFSET has been written.
+ *       pagecache_sync  - write all dirty pages back to the file.
+ *
+ * All but pagecache_bootstrap may sleep.
+ *
+ * The frames themselves are looked after by the VM system, since the
+ * clock may take any that only the cache holds: it clears the entry
+ * holding it. So the cache only changes an entry, once it's set,
+ * through these:
+ *       cache_putpage  - store PA, with its one reference, in empty
+ *                        entry *PTE, and give the caller a reference of
+ *                        its own as well.
+ *       cache_getpage  - a new reference to *PTE's frame, or 0 if it
+ *                        has none any more.
+ *       cache_cleanpage - clear PTE_DIRTY, once the page is written back.
+ *       cache_droppage - let go of *PTE's frame, if any, and clear it.
+ */
+
+#include <vm.h>
+#include <pagetable.h>
+
+struct vnode;
+struct pagecache;
+
+void              pagecache_bootstrap(void);
+struct pagecache *pagecache_get(struct vnode *v);
+struct pagecache *pagecache_find(struct vnode *v);
+void              pagecache_ref(struct pagecache *pc);
+void              pagecache_release(struct pagecache *pc);
+int               pagecache_getpage(struct pagecache *pc, off_t offset,
+                                    paddr_t *ret, bool *fromdisk);
+void              pagecache_dirty(struct pagecache *pc, off_t offset);
+int               pagecache_sync(struct pagecache *pc);
+void              pagecache_shutdown(void);
+
+void              cache_putpage(pte_t *pte, paddr_t pa);
+paddr_t           cache_getpage(pte_t *pte);
+void              cache_cleanpage(pte_t *pte);
+void              cache_droppage(pte_t *pte);
+
+#endif /* _PAGECACHE_H_ */
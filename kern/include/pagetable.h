@@ -0,0 +1,72 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+/*
+ * Two-level page table for user address spaces.
+ *
+ * A user virtual address is split 10/10/12: the top 10 bits index the
+ * first-level directory, the next 10 bits index a second-level table,
+ * and the low 12 bits are the offset within the page. Both levels are
+ * exactly one page in size. Second-level tables are only allocated
+ * once something in the 4M range they cover is mapped, so a sparse
+ * address space (text at the bottom, stack at the top) costs three or
+ * four pages of table.
+ *
+ * Each PTE holds the physical frame in its top 20 bits and flags in
+ * the rest; a PTE of 0 means "nothing here yet". A page that has been
+ * evicted has PTE_SWAPPED set and its swap slot in place of the frame.
+ *
+ * Functions:
+ *       pt_create  - allocate an empty page table. Returns NULL on
+ *                    out-of-memory.
+ *       pt_destroy - free the table structure itself. The frames the
+ *                    entries point at are the caller's business and
+ *                    must already have been released.
+ *       pt_lookup  - return a pointer to the PTE for VADDR, or NULL if
+ *                    the second-level table covering it doesn't exist.
+ *       pt_lookup_alloc - like pt_lookup, but allocates the second-level
+ *                    table if needed. Returns NULL on out-of-memory.
+ *       pt_walk    - call FUNC on every nonzero PTE, in address order.
+ *                    If FUNC returns nonzero the walk stops and that
+ *                    value is returned.
+ */
+
+#include <vm.h>
+
+typedef uint32_t pte_t;
+
+#define PT_L1_ENTRIES   1024
+#define PT_L2_ENTRIES   1024
+#define PT_L1_SHIFT     22
+#define PT_L2_SHIFT     12
+#define PT_L1_INDEX(va) (((va) >> PT_L1_SHIFT) & (PT_L1_ENTRIES - 1))
+#define PT_L2_INDEX(va) (((va) >> PT_L2_SHIFT) & (PT_L2_ENTRIES - 1))
+#define PT_VADDR(l1, l2) \
+	(((vaddr_t)(l1) << PT_L1_SHIFT) | ((vaddr_t)(l2) << PT_L2_SHIFT))
+
+/* PTE fields */
+#define PTE_FRAME       0xfffff000	/* physical frame address */
+#define PTE_VALID       0x00000001	/* frame is resident */
+#define PTE_COW         0x00000002	/* frame is shared; copy before writing */
+#define PTE_BUSY        0x00000004	/* frame is on its way out to swap */
+#define PTE_SWAPPED     0x00000008	/* page is in the swap slot below */
+#define PTE_DIRTY       0x00000010	/* page cache: frame is newer than file */
+#define PTE_WRITABLE    0x00000020	/* vm_fault has let this page be written */
+
+#define PTE_PADDR(pte)  ((paddr_t)((pte) & PTE_FRAME))
+#define PTE_SLOT(pte)   ((unsigned)((pte) >> PT_L2_SHIFT))
+#define PTE_MKSWAP(slot) (((pte_t)(slot) << PT_L2_SHIFT) | PTE_SWAPPED)
+
+struct pagetable {
+	pte_t *pt_dir[PT_L1_ENTRIES];
+};
+
+struct pagetable *pt_create(void);
+void              pt_destroy(struct pagetable *pt);
+pte_t            *pt_lookup(struct pagetable *pt, vaddr_t vaddr);
+pte_t            *pt_lookup_alloc(struct pagetable *pt, vaddr_t vaddr);
+int               pt_walk(struct pagetable *pt,
+                          int (*func)(vaddr_t vaddr, pte_t *pte, void *data),
+                          void *data);
+
+#endif /* _PAGETABLE_H_ */
@@ -42,6 +42,10 @@
 //ASST2
 #include "opt-A2.h"
 //ASST2
+//ASST3
+#include "opt-A3.h"
+#include <limits.h>
+//ASST3
 
 struct addrspace;
 struct vnode;
@@ -62,6 +66,16 @@ struct pid_node_t {
 
 #endif //OPT_A2
 
+#if OPT_A3
+
+/* an open file, as seen through a descriptor */
+struct openfile {
+    struct vnode *of_vnode;	/* NULL if the descriptor is free */
+    int of_flags;		/* O_ flags it was opened with */
+};
+
+#endif //OPT_A3
+
 /*
  * Process structure.
  */
@@ -92,6 +106,11 @@ struct proc {
     struct pid_node_t *pid_node;
 
 #endif //OPT_A2
+
+#if OPT_A3
+    /* files opened with open(); 0-2 are always the console */
+    struct openfile p_files[OPEN_MAX];
+#endif //OPT_A3
 };
 
 #if OPT_A2
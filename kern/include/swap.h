@@ -0,0 +1,35 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space for evicted user pages.
+ *
+ * Swap lives on a raw disk device and is divided into page-sized
+ * slots; a bitmap records which slots are in use. If the device isn't
+ * there at boot the system simply runs without swap and every slot
+ * allocation fails.
+ *
+ * Functions:
+ *       swap_bootstrap - open the swap device and size the slot map.
+ *       swap_alloc     - reserve a free slot. Returns ENOSPC if swap is
+ *                        full (or missing).
+ *       swap_free      - release a slot.
+ *       swap_in        - read a slot into the physical frame at PA.
+ *       swap_out       - write the physical frame at PA to a slot.
+ *
+ * swap_in and swap_out sleep on the disk, so they must not be called
+ * with spinlocks held.
+ */
+
+#include <vm.h>
+
+/* the raw device swap is kept on */
+#define SWAP_DEVICE "lhd0raw:"
+
+void swap_bootstrap(void);
+int  swap_alloc(unsigned *slot);
+void swap_free(unsigned slot);
+int  swap_in(paddr_t pa, unsigned slot);
+int  swap_out(paddr_t pa, unsigned slot);
+
+#endif /* _SWAP_H_ */
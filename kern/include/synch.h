@@ -33,6 +33,9 @@
  */
 #include <spinlock.h>
 //#include <queue.h>     /******for fairness******/
+//ASST3
+#include "opt-A3.h"
+//ASST3
 /*
  * Dijkstra-style semaphore.
  *
@@ -126,4 +129,11 @@ void cv_destroy(struct cv *);
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
+#if OPT_A3
+/*
+ * Set up the caches semaphores, locks and CVs come from. Call once at
+ * boot, after wchan_bootstrap and before any of them is created.
+ */
+void synch_bootstrap(void);
+#endif //OPT_A3
 #endif /* _SYNCH_H_ */
@@ -33,6 +33,9 @@
 //ASST2
 #include "opt-A2.h"
 //ASST2
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 struct trapframe; /* from <machine/trapframe.h> */
 
@@ -49,6 +52,14 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+#if OPT_A3
+/*
+ * Where sys_fork gets the trapframe it hands the child, and where
+ * enter_forked_process puts it back. Set up by proc_bootstrap.
+ */
+extern struct kmem_cache *trapframe_cache;
+#endif //OPT_A3
+
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
                        vaddr_t entrypoint);
@@ -74,6 +85,19 @@ int execv(const char *progname, char **args);
 
 #endif //OPT_A2
 
+#if OPT_A3
+
+int sys_sbrk(intptr_t amount, vaddr_t *retval);
+int sys_open(userptr_t path, int flags, int *retval);
+int sys_close(int fdesc);
+int sys_fsync(int fdesc);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fdesc,
+             off_t offset, vaddr_t *retval);
+int sys_munmap(vaddr_t addr, size_t len);
+int sys_setaffinity(uint32_t cpumask);
+
+#endif //OPT_A3
+
 #endif // UW
 
 #endif /* _SYSCALL_H_ */
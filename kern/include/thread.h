@@ -39,6 +39,9 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 struct cpu;
 
@@ -83,6 +86,17 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+#if OPT_A3
+	/*
+	 * Scheduling level, 0 being the most urgent, and how many times
+	 * schedule() has caught the thread running at that level. Only
+	 * t_cpu touches these, under its run queue lock while the thread
+	 * is on the run queue.
+	 */
+	unsigned t_prio;
+	unsigned t_slices;
+	uint32_t t_affinity;		/* CPUMASK()s of the cpus it may use */
+#endif //OPT_A3
 
 	/*
 	 * Interrupt state fields.
@@ -162,11 +176,53 @@ void thread_yield(void);
  */
 void schedule(void);
 
+#if OPT_A3
+/*
+ * Put every ready thread on this CPU back at the top scheduling level,
+ * so that nothing starves. Called from the timer interrupt.
+ */
+void schedule_reset(void);
+#endif //OPT_A3
+
+#if OPT_A3
+/*
+ * Fold this CPU's run queue length into its load average. Called from
+ * the timer interrupt. Idle CPUs use the load averages to pick whom to
+ * steal ready threads from, instead of busy ones pushing threads away.
+ */
+void thread_update_load(void);
+
+/*
+ * Decay this CPU's load average as if NTICKS timer interrupts had each
+ * found its run queue empty; for the ones an idle CPU skipped.
+ */
+void thread_idle_load(unsigned nticks);
+
+/*
+ * Print each CPU's load average and where its wakeups placed threads.
+ */
+void thread_printstats(void);
+
+/*
+ * Set the cpus thread T may run on, as a mask of CPUMASK(c_number)
+ * bits. New threads inherit their creator's mask. Fails with EINVAL
+ * if the mask names no cpu that exists.
+ *
+ * The current thread, and threads waiting to run, move right away; the
+ * current thread switches away to do so. A sleeping thread moves when
+ * it wakes, and one running on another cpu the next time it yields,
+ * which every hardclock makes it do.
+ */
+#define CPUMASK(n)    ((uint32_t)1 << (n))
+#define CPUMASK_ALL   (~(uint32_t)0)
+int thread_set_affinity(struct thread *t, uint32_t mask);
+#else
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
  */
 void thread_consider_migration(void);
+#endif //OPT_A3
 
 
 #endif /* _THREAD_H_ */
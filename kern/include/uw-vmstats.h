@@ -36,7 +36,16 @@
 #define VMSTAT_ELF_FILE_READ          (7)
 #define VMSTAT_SWAP_FILE_READ         (8)
 #define VMSTAT_SWAP_FILE_WRITE        (9)
-#define VMSTAT_COUNT                 (10)
+#define VMSTAT_ASID_ASSIGN           (10)
+#define VMSTAT_ASID_ROLLOVER         (11)
+#define VMSTAT_ZERO_POOL_HIT         (12)
+#define VMSTAT_ZERO_POOL_MISS        (13)
+#define VMSTAT_MAPPED_FILE_READ      (14)
+#define VMSTAT_CLOCK_SECOND_CHANCE   (15)
+#define VMSTAT_EVICT                 (16)
+#define VMSTAT_TLB_FASTPATH          (17)
+#define VMSTAT_TLB_SLOWPATH          (18)
+#define VMSTAT_COUNT                 (19)
 
 /* ----------------------------------------------------------------------- */
 
@@ -52,6 +61,18 @@ void _vmstats_init(void);                    /* atomicity must be ensured elsewh
 void vmstats_inc(unsigned int index);    /* uses locking */
 void _vmstats_inc(unsigned int index);   /* atomicity must be ensured elsewhere */
 
+/* Count a TLB miss vm_tlbrefill dealt with: a TLB fault, a reload and a
+ * fast path refill, with a free entry or by replacing one. Counted per
+ * cpu, without locking; call with interrupts off. */
+void vmstats_refill(bool replace);       /* no locking needed */
+
+/* Record the working set of a process that is exiting, for vmstats_print:
+ * its peak resident pages, page faults, and lifetime in milliseconds.
+ * Only the last VMSTAT_PROCS are kept. */
+#define VMSTAT_PROCS 8
+void vmstats_proc(const char *name, unsigned maxresident, unsigned faults,
+                  unsigned msecs);
+
 /* Print the statistics: assumes that at least vmstats_init has been called */
 void vmstats_print(void);                    /* Does NOT use locking */
 
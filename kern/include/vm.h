@@ -38,6 +38,9 @@
 
 
 #include <machine/vm.h>
+//ASST3
+#include "opt-A3.h"
+//ASST3
 
 /* Fault-type arguments to vm_fault() */
 #define VM_FAULT_READ        0    /* A read was attempted */
@@ -55,6 +58,42 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
 
+#if OPT_A3
+/* Allocate one zero-filled kernel page, from the pre-zeroed pool if possible */
+vaddr_t alloc_zkpage(void);
+
+/*
+ * Reload the TLB for a miss on a page that is already mapped, straight
+ * from the trap handler with interrupts off. Returns false if it takes
+ * a real page fault, which is then left to vm_fault.
+ */
+bool vm_tlbrefill(vaddr_t faultaddress, bool iswrite);
+
+/* Background work for an idle cpu; returns false if there was none */
+bool vm_idle(void);
+
+/*
+ * A word kmalloc keeps with each kernel page it owns; 0 until set, and
+ * always 0 for pages allocated before vm_bootstrap.
+ */
+void kpage_settag(vaddr_t addr, unsigned tag);
+unsigned kpage_gettag(vaddr_t addr);
+
+/* True for a kernel page taken before vm_bootstrap; it can't be freed */
+bool kpage_isstolen(vaddr_t addr);
+
+/* Print free physical memory per buddy allocator order */
+void coremap_printstats(void);
+
+/*
+ * Reference-counted frames for user pages, for code outside the VM
+ * system that hands them to page tables (the page cache). alloc_upage
+ * returns a zero-filled frame with one reference, or 0.
+ */
+paddr_t alloc_upage(void);
+void free_upage(paddr_t pa);
+#endif //OPT_A3
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown_all(void);
 void vm_tlbshootdown(const struct tlbshootdown *);
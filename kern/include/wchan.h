@@ -30,12 +30,17 @@
 #ifndef _WCHAN_H_
 #define _WCHAN_H_
 
+//ASST3
+#include "opt-A3.h"
+//ASST3
+
 /*
  * Wait channel.
  */
 
 
 struct wchan; /* Opaque */
+struct thread; /* from <thread.h> */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -49,6 +54,20 @@ struct wchan *wchan_create(const char *name);
  */
 void wchan_destroy(struct wchan *wc);
 
+#if OPT_A3
+/*
+ * Set up the cache wait channels come from; call once at boot, before
+ * the first wchan_create.
+ */
+void wchan_bootstrap(void);
+
+/*
+ * Rename a wait channel, for objects that keep theirs while their own
+ * name changes. NAME is subject to the same rules as for wchan_create.
+ */
+void wchan_setname(struct wchan *wc, const char *name);
+#endif //OPT_A3
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -81,5 +100,13 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+#if OPT_A3
+/*
+ * Wake up one particular thread T, which must be sleeping on the
+ * channel. The queue should not already be locked.
+ */
+void wchan_wakethread(struct wchan *wc, struct thread *t);
+#endif //OPT_A3
+
 
 #endif /* _WCHAN_H_ */
@@ -58,6 +58,13 @@
 //#include <thread.h>
 //ASST2
 
+//ASST3
+#include "opt-A3.h"
+#include <kmem_cache.h>
+#include <syscall.h>
+#include <machine/trapframe.h>
+//ASST3
+
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
@@ -85,6 +92,41 @@ struct cv *pid_cv = NULL;
 
 #endif //OPT_A2
 
+#if OPT_A3
+
+static struct kmem_cache *proc_cache;
+#if OPT_A2
+static struct kmem_cache *pid_cache;
+#endif //OPT_A2
+struct kmem_cache *trapframe_cache;
+
+/*
+ * kmem_cache constructor and destructor for procs: an empty thread
+ * array and a fresh spinlock, which proc_destroy leaves that way.
+ */
+static
+int
+proc_ctor(void *obj)
+{
+    struct proc *proc = obj;
+
+    threadarray_init(&proc->p_threads);
+    spinlock_init(&proc->p_lock);
+    return 0;
+}
+
+static
+void
+proc_dtor(void *obj)
+{
+    struct proc *proc = obj;
+
+    threadarray_cleanup(&proc->p_threads);
+    spinlock_cleanup(&proc->p_lock);
+}
+
+#endif //OPT_A3
+
 /*
  * Create a proc structure.
  */
@@ -94,6 +136,17 @@ proc_create(const char *name)
 {
     struct proc *proc;
 
+#if OPT_A3
+    proc = kmem_cache_alloc(proc_cache);
+    if (proc == NULL) {
+        return NULL;
+    }
+    proc->p_name = kstrdup(name);
+    if (proc->p_name == NULL) {
+        kmem_cache_free(proc_cache, proc);
+        return NULL;
+    }
+#else
     proc = kmalloc(sizeof(*proc));
     if (proc == NULL) {
         return NULL;
@@ -106,6 +159,7 @@ proc_create(const char *name)
 
     threadarray_init(&proc->p_threads);
     spinlock_init(&proc->p_lock);
+#endif //OPT_A3
 
     /* VM fields */
     proc->p_addrspace = NULL;
@@ -117,6 +171,13 @@ proc_create(const char *name)
     proc->console = NULL;
 #endif // UW
 
+#if OPT_A3
+    for (int i = 0; i < OPEN_MAX; i++) {
+        proc->p_files[i].of_vnode = NULL;
+        proc->p_files[i].of_flags = 0;
+    }
+#endif //OPT_A3
+
     return proc;
 }
 
@@ -177,11 +238,26 @@ proc_destroy(struct proc *proc)
     }
 #endif // UW
 
+#if OPT_A3
+    for (int i = 0; i < OPEN_MAX; i++) {
+        if (proc->p_files[i].of_vnode != NULL) {
+            vfs_close(proc->p_files[i].of_vnode);
+        }
+    }
+#endif //OPT_A3
+
+#if OPT_A3
+    //back to the cache as proc_ctor left it
+    KASSERT(threadarray_num(&proc->p_threads) == 0);
+    kfree(proc->p_name);
+    kmem_cache_free(proc_cache, proc);
+#else
     threadarray_cleanup(&proc->p_threads);
     spinlock_cleanup(&proc->p_lock);
 
     kfree(proc->p_name);
     kfree(proc);
+#endif //OPT_A3
 
 #ifdef UW
     /* decrement the process count */
@@ -212,6 +288,16 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+#if OPT_A3
+    proc_cache = kmem_cache_create("proc", sizeof(struct proc),
+                                   proc_ctor, proc_dtor);
+#if OPT_A2
+    pid_cache = kmem_cache_create("pid", sizeof(struct pid_node_t),
+                                  NULL, NULL);
+#endif //OPT_A2
+    trapframe_cache = kmem_cache_create("trapframe",
+                                        sizeof(struct trapframe), NULL, NULL);
+#endif //OPT_A3
     kproc = proc_create("[kernel]");
     if (kproc == NULL) {
         panic("proc_create for kproc failed\n");
@@ -267,7 +353,11 @@ proc_create_runprogram(const char *name)
     proc->pid_node = pid_create();
     if(proc->pid_node == NULL) {
         kfree(proc->p_name);
+#if OPT_A3
+        kmem_cache_free(proc_cache, proc);
+#else
         kfree(proc);
+#endif //OPT_A3
         return NULL;
     }
     
@@ -426,7 +516,11 @@ pid_create(void)
         panic("pid exceeds PID_MAX!\r\n");
     }
 
+#if OPT_A3
+    struct pid_node_t *pid_node = kmem_cache_alloc(pid_cache);
+#else
     struct pid_node_t *pid_node = kmalloc(sizeof(struct pid_node_t));
+#endif //OPT_A3
     if(pid_node == NULL) {
         return NULL;
     }
@@ -463,7 +557,11 @@ pid_destroy_tree(struct pid_node_t * pid_node)
         pid_node->right_sibling = NULL;
     }
     //finally, free sefl
+#if OPT_A3
+    kmem_cache_free(pid_cache, pid_node);
+#else
     kfree(pid_node);
+#endif //OPT_A3
     pid_node = NULL;
 }
 
@@ -51,6 +51,13 @@
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
 
+//ASST3
+#include "opt-A3.h"
+#include <uw-vmstats.h>
+#include <wchan.h>
+#include <pagecache.h>
+//ASST3
+
 
 /*
  * These two pieces of data are maintained by the makefiles and build system.
@@ -107,6 +114,11 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+#if OPT_A3
+	/* object caches, before anything in them is created */
+	wchan_bootstrap();
+	synch_bootstrap();
+#endif //OPT_A3
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
@@ -149,10 +161,18 @@ shutdown(void)
 	
 	vfs_clearbootfs();
 	vfs_clearcurdir();
+#if OPT_A3
+	//cached program text keeps files open
+	pagecache_shutdown();
+#endif //OPT_A3
 	vfs_unmountall();
 
 	thread_shutdown();
 
+#if OPT_A3
+	vmstats_print();
+#endif //OPT_A3
+
 	splhigh();
 }
 
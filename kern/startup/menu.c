@@ -50,6 +50,11 @@
 #include "opt-A2.h"
 #include <test.h>
 //ASST2b
+//ASST3
+#include "opt-A3.h"
+#include <vm.h>
+#include <kmem_cache.h>
+//ASST3
 
 
 /*
@@ -417,6 +422,60 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_KMALLOCPROF
+static
+int
+cmd_kmallocprofile(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kmalloc_printprofile();
+
+	return 0;
+}
+#endif
+
+#if OPT_A3
+
+static
+int
+cmd_coremapstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	coremap_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_kcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kmem_cache_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_cpustats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+#endif //OPT_A3
+
 
 /*
  * Command for dth.
@@ -545,6 +604,14 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_KMALLOCPROF
+	"[kp] Kernel heap top consumers      ",
+#endif
+#if OPT_A3
+	"[cm] Physical memory stats          ",
+	"[kc] Kernel object cache stats      ",
+	"[cs] CPU load and wakeup stats      ",
+#endif //OPT_A3
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -602,6 +669,14 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+#if OPT_KMALLOCPROF
+	{ "kp",         cmd_kmallocprofile },
+#endif
+#if OPT_A3
+	{ "cm",         cmd_coremapstats },
+	{ "kc",         cmd_kcachestats },
+	{ "cs",         cmd_cpustats },
+#endif //OPT_A3
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -9,6 +9,16 @@
 #include <current.h>
 #include <proc.h>
 
+//ASST3
+#include "opt-A3.h"
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <limits.h>
+#include <copyinout.h>
+#include <addrspace.h>
+#include <pagecache.h>
+//ASST3
+
 /* handler for write() system call                  */
 /*
  * n.b.
@@ -58,3 +68,140 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+
+#if OPT_A3
+
+/*
+ * open(), close() and fsync(). Descriptors only name vnodes for now,
+ * which is all mmap() needs; read() and write() still only know about
+ * the console.
+ */
+
+/* the open file FDESC refers to, or NULL */
+static
+struct openfile *
+file_get(int fdesc)
+{
+  if (fdesc < 0 || fdesc >= OPEN_MAX) {
+    return NULL;
+  }
+  if (curproc->p_files[fdesc].of_vnode == NULL) {
+    return NULL;
+  }
+  return &curproc->p_files[fdesc];
+}
+
+int
+sys_open(userptr_t upath, int flags, int *retval)
+{
+  char path[PATH_MAX];
+  struct vnode *vn;
+  int fdesc, res;
+
+  res = copyinstr(upath, path, sizeof(path), NULL);
+  if (res) {
+    return res;
+  }
+
+  /* 0, 1 and 2 belong to the console */
+  for (fdesc = STDERR_FILENO + 1; fdesc < OPEN_MAX; fdesc++) {
+    if (curproc->p_files[fdesc].of_vnode == NULL) {
+      break;
+    }
+  }
+  if (fdesc == OPEN_MAX) {
+    return EMFILE;
+  }
+
+  res = vfs_open(path, flags, 0, &vn);
+  if (res) {
+    return res;
+  }
+  curproc->p_files[fdesc].of_vnode = vn;
+  curproc->p_files[fdesc].of_flags = flags;
+  *retval = fdesc;
+  return 0;
+}
+
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+
+  of = file_get(fdesc);
+  if (of == NULL) {
+    return EBADF;
+  }
+  vfs_close(of->of_vnode);
+  of->of_vnode = NULL;
+  of->of_flags = 0;
+  return 0;
+}
+
+int
+sys_fsync(int fdesc)
+{
+  struct openfile *of;
+  struct pagecache *pc;
+  int res;
+
+  of = file_get(fdesc);
+  if (of == NULL) {
+    return EBADF;
+  }
+
+  /* changes made through shared mappings go out first */
+  pc = pagecache_find(of->of_vnode);
+  if (pc != NULL) {
+    res = pagecache_sync(pc);
+    pagecache_release(pc);
+    if (res) {
+      return res;
+    }
+  }
+  return VOP_FSYNC(of->of_vnode);
+}
+
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fdesc,
+         off_t offset, vaddr_t *retval)
+{
+  struct openfile *of;
+  int accmode, res;
+
+  (void)addr;  /* only a hint, and we don't take hints */
+
+  if ((prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0 ||
+      (flags != MAP_SHARED && flags != MAP_PRIVATE)) {
+    return EINVAL;
+  }
+
+  of = file_get(fdesc);
+  if (of == NULL) {
+    return EBADF;
+  }
+  /* the file has to be readable, and writable to be written through */
+  accmode = of->of_flags & O_ACCMODE;
+  if (accmode == O_WRONLY ||
+      (flags == MAP_SHARED && (prot & PROT_WRITE) && accmode != O_RDWR)) {
+    return EACCES;
+  }
+
+  res = VOP_MMAP(of->of_vnode);
+  if (res) {
+    return res;
+  }
+
+  KASSERT(curproc->p_addrspace != NULL);
+  return as_mmap(curproc->p_addrspace, of->of_vnode, len, prot,
+                 flags == MAP_SHARED, offset, retval);
+}
+
+int
+sys_munmap(vaddr_t addr, size_t len)
+{
+  KASSERT(curproc->p_addrspace != NULL);
+  return as_munmap(curproc->p_addrspace, addr, len);
+}
+
+#endif //OPT_A3
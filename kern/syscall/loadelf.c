@@ -59,6 +59,11 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+//ASST3
+#include "opt-A3.h"
+//ASST3
+
+#if !OPT_A3
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -145,6 +150,8 @@ load_segment(struct addrspace *as, struct vnode *v,
 	return result;
 }
 
+#endif //!OPT_A3
+
 /*
  * Load an ELF executable user program into the current address space.
  *
@@ -251,6 +258,21 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		if (result) {
 			return result;
 		}
+
+#if OPT_A3
+
+		//nothing is read now; vm_fault pulls each page in when it's touched
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > segment memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+		result = as_define_file(as, v, ph.p_vaddr, ph.p_filesz,
+					ph.p_offset);
+		if (result) {
+			return result;
+		}
+
+#endif //OPT_A3
 	}
 
 	result = as_prepare_load(as);
@@ -258,6 +280,9 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
+#if !OPT_A3
+
+
 	/*
 	 * Now actually load each segment.
 	 */
@@ -296,6 +321,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		}
 	}
 
+#endif //!OPT_A3
+
 	result = as_complete_load(as);
 	if (result) {
 		return result;
@@ -23,6 +23,12 @@
 #include <limits.h>
 //ASST2b
 
+//ASST3
+#include "opt-A3.h"
+#include <vnode.h>
+#include <kmem_cache.h>
+//ASST3
+
 /* this implementation of sys__exit does not do anything with the exit code */
 /* this needs to be fixed to get exit() and waitpid() working properly */
 
@@ -54,6 +60,9 @@ void sys__exit(int exitcode)
      * messily fatal.
      */
     as = curproc_setas(NULL);
+#if OPT_A3
+    as_exitstats(as, p->p_name);
+#endif //OPT_A3
     as_destroy(as);
 
     /* detach this thread from its process */
@@ -81,6 +90,31 @@ void sys__exit(int exitcode)
 }
 
 
+#if OPT_A3
+
+/* move the heap break by AMOUNT bytes and return the old one */
+int
+sys_sbrk(intptr_t amount, vaddr_t *retval)
+{
+    struct addrspace *as;
+
+    as = curproc_getas();
+    KASSERT(as != NULL);
+    return as_sbrk(as, amount, retval);
+}
+
+/*
+ * pin the calling process to the cpus in CPUMASK; its children inherit
+ * that. Processes have just the one thread.
+ */
+int
+sys_setaffinity(uint32_t cpumask)
+{
+    return thread_set_affinity(curthread, cpumask);
+}
+
+#endif //OPT_A3
+
 /* stub handler for getpid() system call                */
 int
 sys_getpid(pid_t *retval)
@@ -176,7 +210,11 @@ int sys_fork(struct trapframe *tf, pid_t *retval)
 
     int result;
 
+#if OPT_A3
+    struct trapframe *child_tf = kmem_cache_alloc(trapframe_cache);
+#else
     struct trapframe *child_tf = kmalloc(sizeof(struct trapframe));
+#endif //OPT_A3
 
     if (child_tf == NULL) {
         return ENOMEM;
@@ -187,17 +225,36 @@ int sys_fork(struct trapframe *tf, pid_t *retval)
     //create a child process
     struct proc *child_proc = proc_create_runprogram(curproc->p_name);
     if (child_proc == NULL) {
+#if OPT_A3
+        kmem_cache_free(trapframe_cache, child_tf);
+#else
         kfree(child_tf);
+#endif //OPT_A3
         return(ENPROC);
     }
     //copy address space to its child
     result = as_copy(curproc->p_addrspace, &child_proc->p_addrspace);
     if(result) {
+#if OPT_A3
+        kmem_cache_free(trapframe_cache, child_tf);
+#else
         kfree(child_tf);
+#endif //OPT_A3
         proc_destroy(child_proc);
         return result;
     }
 
+#if OPT_A3
+    //the child inherits every open file
+    for (int i = 0; i < OPEN_MAX; i++) {
+        child_proc->p_files[i] = curproc->p_files[i];
+        if (child_proc->p_files[i].of_vnode != NULL) {
+            VOP_INCOPEN(child_proc->p_files[i].of_vnode);
+            VOP_INCREF(child_proc->p_files[i].of_vnode);
+        }
+    }
+#endif //OPT_A3
+
     //add a new child
     pid_add_child(curproc->pid_node, child_proc->pid_node);
 
@@ -207,7 +264,11 @@ int sys_fork(struct trapframe *tf, pid_t *retval)
     if (result) {
         as_destroy(child_proc->p_addrspace);
         proc_destroy(child_proc);
+#if OPT_A3
+        kmem_cache_free(trapframe_cache, child_tf);
+#else
         kfree(child_tf);
+#endif //OPT_A3
         return result;
     }
 
@@ -35,6 +35,12 @@
 #include <thread.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
+//ASST3
+#include "opt-A3.h"
+#include <spl.h>
+#include <spinlock.h>
+#include <mainbus.h>
+//ASST3
 
 /*
  * Time handling.
@@ -52,8 +58,218 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
+#if OPT_A3
+#define RESET_HARDCLOCKS	HZ	/* Reset priorities once a second. */
+#else
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#endif //OPT_A3
 
+#if OPT_A3
+/*
+ * Timed sleeps. Each cpu keeps the threads that went to sleep on it
+ * in a list sorted by absolute deadline, counted in timerclock ticks,
+ * and its hardclock wakes each of them once when the deadline passes.
+ * The record lives on the sleeper's stack.
+ */
+struct timeout {
+	uint32_t to_deadline;
+	struct thread *to_thread;
+	struct timeout *to_next;
+};
+
+/* timerclock ticks since boot; wraps after about 500 days */
+static volatile uint32_t timer_now;
+
+#define TIMER_PER_SECOND	(1000000/LT_GRANULARITY)
+
+/* deadline a is due by time b, allowing for wraparound */
+#define TIMER_DUE(a, b)		((int32_t)((a) - (b)) <= 0)
+
+/* longest an idle cpu goes without a hardclock; it still steals work */
+#define IDLE_MAXHARDCLOCKS	(HZ/10)
+
+/*
+ * Setup.
+ */
+void
+hardclock_bootstrap(void)
+{
+	KASSERT(TIMER_PER_SECOND > 0);
+	timer_now = 0;
+}
+
+/*
+ * Set up a cpu's timer queue. Called from cpu_create.
+ */
+void
+timerq_init(struct timerq *tq)
+{
+	spinlock_init(&tq->tq_lock);
+	tq->tq_head = NULL;
+	tq->tq_wchan = wchan_create("timerq");
+	if (tq->tq_wchan == NULL) {
+		panic("Couldn't create timer queue\n");
+	}
+	tq->tq_deferred = false;
+	tq->tq_idlestart = 0;
+	tq->tq_idlehardclocks = 0;
+}
+
+/*
+ * This is called once every every LT_GRANULARITY usec, on one processor,
+ * by the timer code.
+ */
+void
+timerclock(void)
+{
+	timer_now++;
+}
+
+/*
+ * Wake everything on this cpu's timer queue whose deadline has passed.
+ */
+static
+void
+timer_expire(void)
+{
+	struct timerq *tq;
+	struct timeout *to;
+	struct thread *t;
+
+	tq = &curcpu->c_timerq;
+	/* unlocked peek; only this cpu adds to its own queue */
+	if (tq->tq_head == NULL) {
+		return;
+	}
+	while (1) {
+		spinlock_acquire(&tq->tq_lock);
+		to = tq->tq_head;
+		if (to == NULL || !TIMER_DUE(to->to_deadline, timer_now)) {
+			spinlock_release(&tq->tq_lock);
+			break;
+		}
+		tq->tq_head = to->to_next;
+		t = to->to_thread;
+		spinlock_release(&tq->tq_lock);
+		/* the record is dead once t runs; don't touch it again */
+		wchan_wakethread(tq->tq_wchan, t);
+	}
+}
+
+/*
+ * Sleep until timer_now reaches DEADLINE.
+ */
+static
+void
+timer_sleep(uint32_t deadline)
+{
+	struct timerq *tq;
+	struct timeout to, **pp;
+	int spl;
+
+	to.to_deadline = deadline;
+	to.to_thread = curthread;
+
+	/*
+	 * Don't move cpus between picking this cpu's queue and locking
+	 * its wchan; after that the wchan lock keeps us here.
+	 */
+	spl = splhigh();
+	tq = &curcpu->c_timerq;
+	wchan_lock(tq->tq_wchan);
+	splx(spl);
+
+	spinlock_acquire(&tq->tq_lock);
+	if (TIMER_DUE(deadline, timer_now)) {
+		spinlock_release(&tq->tq_lock);
+		wchan_unlock(tq->tq_wchan);
+		return;
+	}
+	for (pp = &tq->tq_head; *pp != NULL; pp = &(*pp)->to_next) {
+		if (!TIMER_DUE((*pp)->to_deadline, deadline)) {
+			break;
+		}
+	}
+	to.to_next = *pp;
+	*pp = &to;
+	spinlock_release(&tq->tq_lock);
+	wchan_sleep(tq->tq_wchan);
+}
+
+/*
+ * Called by an idle cpu just before it waits: push its next hardclock
+ * out to the first deadline on its timer queue, up to
+ * IDLE_MAXHARDCLOCKS away. Interrupts are off.
+ */
+void
+hardclock_idle(void)
+{
+	struct timerq *tq;
+	unsigned ticks;
+	int32_t left;
+
+	tq = &curcpu->c_timerq;
+	ticks = IDLE_MAXHARDCLOCKS;
+	spinlock_acquire(&tq->tq_lock);
+	if (tq->tq_head != NULL) {
+		left = (int32_t)(tq->tq_head->to_deadline - timer_now);
+		if (left <= 0) {
+			ticks = 1;
+		}
+		else if (left < TIMER_PER_SECOND) {
+			ticks = DIVROUNDUP((unsigned)left * HZ, TIMER_PER_SECOND);
+			if (ticks > IDLE_MAXHARDCLOCKS) {
+				ticks = IDLE_MAXHARDCLOCKS;
+			}
+		}
+	}
+	spinlock_release(&tq->tq_lock);
+
+	if (ticks > 1) {
+		mainbus_timer_defer(ticks);
+		tq->tq_deferred = true;
+		tq->tq_idlestart = timer_now;
+		tq->tq_idlehardclocks = curcpu->c_hardclocks;
+	}
+}
+
+/*
+ * Called when the idle cpu wakes up again: go back to a hardclock
+ * every tick, since there may be something to run now. Then do the
+ * bookkeeping the skipped hardclocks would have done, so that the
+ * load average and the priority resets don't fall behind.
+ */
+void
+hardclock_unidle(void)
+{
+	struct timerq *tq;
+	unsigned elapsed, ran, skipped, before;
+
+	tq = &curcpu->c_timerq;
+	if (!tq->tq_deferred) {
+		return;
+	}
+	tq->tq_deferred = false;
+	mainbus_timer_defer(1);
+
+	/* to the nearest timerclock tick, which is close enough */
+	elapsed = (timer_now - tq->tq_idlestart) * HZ / TIMER_PER_SECOND;
+	ran = curcpu->c_hardclocks - tq->tq_idlehardclocks;
+	if (elapsed <= ran) {
+		return;
+	}
+	skipped = elapsed - ran;
+
+	before = curcpu->c_hardclocks;
+	curcpu->c_hardclocks += skipped;
+	if (before / RESET_HARDCLOCKS != curcpu->c_hardclocks / RESET_HARDCLOCKS) {
+		schedule_reset();
+	}
+	//the run queue was empty the whole time
+	thread_idle_load(skipped);
+}
+
+#else
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
  */
@@ -108,6 +324,8 @@ timerclock(void)
 	}
 }
 
+#endif //OPT_A3
+
 /*
  * This is called HZ times a second (on each processor) by the timer
  * code.
@@ -119,13 +337,24 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+#if OPT_A3
+	timer_expire();
+#endif //OPT_A3
+
 	curcpu->c_hardclocks++;
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
+#if OPT_A3
+	if ((curcpu->c_hardclocks % RESET_HARDCLOCKS) == 0) {
+		schedule_reset();
+	}
+	thread_update_load();
+#else
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
+#endif //OPT_A3
 	thread_yield();
 }
 
@@ -135,11 +364,17 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
+#if OPT_A3
+  if (num_secs > 0) {
+    timer_sleep(timer_now + (uint32_t)num_secs * TIMER_PER_SECOND);
+  }
+#else
   while (num_secs > 0) {
     wchan_lock(lbolt);
     wchan_sleep(lbolt);
     num_secs--;
   }
+#endif //OPT_A3
 }
 
 /*
@@ -149,9 +384,15 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
+#if OPT_A3
+  if (num_ticks > 0) {
+    timer_sleep(timer_now + (uint32_t)num_ticks);
+  }
+#else
   while (num_ticks > 0) {
     wchan_lock(minibolt);
     wchan_sleep(minibolt);
     num_ticks--;
   }
+#endif //OPT_A3
 }
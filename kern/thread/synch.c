@@ -37,6 +37,90 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+//ASST3
+#include <kern/errno.h>
+#include <kmem_cache.h>
+//ASST3
+#if OPT_A3
+////////////////////////////////////////////////////////////
+//
+// Object caches.
+//
+// Each primitive is cached with its wait channel made and its spinlock
+// set up; create only copies the name in, and destroy only frees it.
+static struct kmem_cache *sem_cache;
+static struct kmem_cache *lock_cache;
+static struct kmem_cache *cv_cache;
+static
+int
+sem_ctor(void *obj)
+{
+	struct semaphore *sem = obj;
+	sem->sem_wchan = wchan_create("sem");
+	if (sem->sem_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&sem->sem_lock);
+	return 0;
+}
+static
+void
+sem_dtor(void *obj)
+{
+	struct semaphore *sem = obj;
+	spinlock_cleanup(&sem->sem_lock);
+	wchan_destroy(sem->sem_wchan);
+}
+static
+int
+lock_ctor(void *obj)
+{
+	struct lock *lock = obj;
+	lock->lk_wchan = wchan_create("lock");
+	if (lock->lk_wchan == NULL) {
+		return ENOMEM;
+	}
+	lock->held = NULL;
+	spinlock_init(&lock->lk_sl);
+	return 0;
+}
+static
+void
+lock_dtor(void *obj)
+{
+	struct lock *lock = obj;
+	spinlock_cleanup(&lock->lk_sl);
+	wchan_destroy(lock->lk_wchan);
+}
+static
+int
+cv_ctor(void *obj)
+{
+	struct cv *cv = obj;
+	cv->cv_wchan = wchan_create("cv");
+	if (cv->cv_wchan == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
+static
+void
+cv_dtor(void *obj)
+{
+	struct cv *cv = obj;
+	wchan_destroy(cv->cv_wchan);
+}
+void
+synch_bootstrap(void)
+{
+	sem_cache = kmem_cache_create("semaphore", sizeof(struct semaphore),
+				      sem_ctor, sem_dtor);
+	lock_cache = kmem_cache_create("lock", sizeof(struct lock),
+				       lock_ctor, lock_dtor);
+	cv_cache = kmem_cache_create("cv", sizeof(struct cv),
+				     cv_ctor, cv_dtor);
+}
+#endif //OPT_A3
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -45,6 +129,18 @@ sem_create(const char *name, int initial_count)
 {
 	struct semaphore *sem;
 	KASSERT(initial_count >= 0);
+#if OPT_A3
+	sem = kmem_cache_alloc(sem_cache);
+	if (sem == NULL) {
+		return NULL;
+	}
+	sem->sem_name = kstrdup(name);
+	if (sem->sem_name == NULL) {
+		kmem_cache_free(sem_cache, sem);
+		return NULL;
+	}
+	wchan_setname(sem->sem_wchan, sem->sem_name);
+#else
 	sem = kmalloc(sizeof(struct semaphore));
 	if (sem == NULL) {
 		return NULL;
@@ -61,6 +157,7 @@ sem_create(const char *name, int initial_count)
 		return NULL;
 	}
 	spinlock_init(&sem->sem_lock);
+#endif //OPT_A3
 	sem->sem_count = initial_count;
 	return sem;
 }
@@ -68,11 +165,18 @@ void
 sem_destroy(struct semaphore *sem)
 {
 	KASSERT(sem != NULL);
+#if OPT_A3
+	KASSERT(wchan_isempty(sem->sem_wchan));
+	wchan_setname(sem->sem_wchan, "sem");
+	kfree(sem->sem_name);
+	kmem_cache_free(sem_cache, sem);
+#else
 	/* wchan_cleanup will assert if anyone's waiting on it */
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
 	kfree(sem->sem_name);
 	kfree(sem);
+#endif //OPT_A3
 }
 void
 P(struct semaphore *sem)
@@ -129,6 +233,19 @@ struct lock *
 lock_create(const char *name)
 {
 	struct lock *lock;
+#if OPT_A3
+	lock = kmem_cache_alloc(lock_cache);
+	if (lock == NULL) {
+		return NULL;
+	}
+	lock->lk_name = kstrdup(name);
+	if (lock->lk_name == NULL) {
+		kmem_cache_free(lock_cache, lock);
+		return NULL;
+	}
+	wchan_setname(lock->lk_wchan, lock->lk_name);
+	return lock;
+#else
 	lock = kmalloc(sizeof(struct lock));
 	if (lock == NULL) {
 		return NULL;
@@ -157,16 +274,25 @@ lock_create(const char *name)
 	lock->held = NULL;
 	spinlock_init(&lock->lk_sl);
 	return lock;
+#endif //OPT_A3
 }
 void
 lock_destroy(struct lock *lock)
 {
 	KASSERT(lock != NULL);
+#if OPT_A3
+	KASSERT(lock->held == NULL);
+	KASSERT(wchan_isempty(lock->lk_wchan));
+	wchan_setname(lock->lk_wchan, "lock");
+	kfree(lock->lk_name);
+	kmem_cache_free(lock_cache, lock);
+#else
 	spinlock_cleanup(&lock->lk_sl);
 	wchan_destroy(lock->lk_wchan);
 //	q_destroy(lock->lk_queue);		/******for fairness******/
 	kfree(lock->lk_name);
 	kfree(lock);
+#endif //OPT_A3
 }
 void
 lock_acquire(struct lock *lock)
@@ -213,6 +339,18 @@ struct cv *
 cv_create(const char *name)
 {
 	struct cv *cv;
+#if OPT_A3
+	cv = kmem_cache_alloc(cv_cache);
+	if (cv == NULL) {
+		return NULL;
+	}
+	cv->cv_name = kstrdup(name);
+	if (cv->cv_name == NULL) {
+		kmem_cache_free(cv_cache, cv);
+		return NULL;
+	}
+	wchan_setname(cv->cv_wchan, cv->cv_name);
+#else
 	cv = kmalloc(sizeof(struct cv));
 	if (cv == NULL) {
 		return NULL;
@@ -229,6 +367,7 @@ cv_create(const char *name)
 		kfree(cv);
 		return NULL;
 	}
+#endif //OPT_A3
 	return cv;
 }
 void
@@ -236,9 +375,16 @@ cv_destroy(struct cv *cv)
 {
 	KASSERT(cv != NULL);
 	// add stuff here as needed
+#if OPT_A3
+	KASSERT(wchan_isempty(cv->cv_wchan));
+	wchan_setname(cv->cv_wchan, "cv");
+	kfree(cv->cv_name);
+	kmem_cache_free(cv_cache, cv);
+#else
 	wchan_destroy(cv->cv_wchan);
 	kfree(cv->cv_name);
 	kfree(cv);
+#endif //OPT_A3
 }
 void
 cv_wait(struct cv *cv, struct lock *lock)
@@ -52,6 +52,11 @@
 #include <vnode.h>
 
 #include "opt-synchprobs.h"
+//ASST3
+#include "opt-A3.h"
+#include <kmem_cache.h>
+#include <clock.h>
+//ASST3
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -111,6 +116,37 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+#if OPT_A3
+
+static struct kmem_cache *thread_cache;
+
+/*
+ * kmem_cache constructor and destructor: the parts of a thread that
+ * are the same every time, and that thread_destroy leaves that way.
+ */
+static
+int
+thread_ctor(void *obj)
+{
+	struct thread *thread = obj;
+
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	return 0;
+}
+
+static
+void
+thread_dtor(void *obj)
+{
+	struct thread *thread = obj;
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+}
+
+#endif //OPT_A3
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -123,26 +159,42 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
+#if OPT_A3
+	thread = kmem_cache_alloc(thread_cache);
+#else
 	thread = kmalloc(sizeof(*thread));
+#endif //OPT_A3
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
+#if OPT_A3
+		kmem_cache_free(thread_cache, thread);
+#else
 		kfree(thread);
+#endif //OPT_A3
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
+#if !OPT_A3
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
+#endif //!OPT_A3
 	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+#if OPT_A3
+	//new threads start at the top, like ones that just woke up
+	thread->t_prio = 0;
+	thread->t_slices = 0;
+	thread->t_affinity = CPUMASK_ALL;
+#endif //OPT_A3
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -180,6 +232,15 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+#if OPT_A3
+	c->c_loadavg = 0;
+	c->c_wake_last = 0;
+	c->c_wake_idle = 0;
+	c->c_wake_least = 0;
+	c->c_migrant = NULL;
+	c->c_idlethread = NULL;
+	timerq_init(&c->c_timerq);
+#endif //OPT_A3
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -187,6 +248,9 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+#if OPT_A3
+	c->c_shootdown_gen = 0;
+#endif //OPT_A3
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -252,14 +316,23 @@ thread_destroy(struct thread *thread)
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
+#if !OPT_A3
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
+#endif //!OPT_A3
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
+#if OPT_A3
+	//the list node is unlinked, as thread_ctor left it
+	KASSERT(thread->t_listnode.tln_prev == NULL);
+	KASSERT(thread->t_listnode.tln_next == NULL);
+	kmem_cache_free(thread_cache, thread);
+#else
 	kfree(thread);
+#endif //OPT_A3
 }
 
 /*
@@ -351,6 +424,11 @@ thread_bootstrap(void)
 
 	cpuarray_init(&allcpus);
 
+#if OPT_A3
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread),
+					 thread_ctor, thread_dtor);
+#endif //OPT_A3
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -406,6 +484,60 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+#if OPT_A3
+/*
+ * Body of a cpu's idle thread. thread_switch runs it only when the
+ * thread switching away has to leave the cpu and nothing else is
+ * waiting; it places that thread on the way in, and parks again.
+ */
+static
+void
+thread_idleloop(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		thread_yield();
+	}
+}
+
+/*
+ * Give cpu C its idle thread. Like thread_fork, except that the thread
+ * goes on no run queue: it waits in c_idlethread until it's needed.
+ */
+static
+void
+thread_idle_create(struct cpu *c)
+{
+	struct thread *t;
+	char namebuf[16];
+	int result;
+
+	snprintf(namebuf, sizeof(namebuf), "<idle #%d>", c->c_number);
+	t = thread_create(namebuf);
+	if (t == NULL) {
+		panic("thread_idle_create: Out of memory\n");
+	}
+	t->t_stack = kmalloc(STACK_SIZE);
+	if (t->t_stack == NULL) {
+		panic("thread_idle_create: Out of memory\n");
+	}
+	thread_checkstack_init(t);
+	t->t_cpu = c;
+	t->t_affinity = CPUMASK(c->c_number);
+	result = proc_addthread(kproc, t);
+	if (result) {
+		panic("thread_idle_create: proc_addthread: %s\n",
+		      strerror(result));
+	}
+	/* it comes out of thread_switch holding the run queue lock too */
+	t->t_iplhigh_count++;
+	switchframe_init(t, thread_idleloop, NULL, 0);
+	c->c_idlethread = t;
+}
+#endif //OPT_A3
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -424,8 +556,92 @@ thread_start_cpus(void)
 	}
 	sem_destroy(cpu_startup_sem);
 	cpu_startup_sem = NULL;
+
+#if OPT_A3
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		thread_idle_create(cpuarray_get(&allcpus, i));
+	}
+#endif //OPT_A3
 }
 
+#if OPT_A3
+
+/*
+ * Scheduling levels. A thread starts at level 0 and drops a level each
+ * time schedule() has caught it running mlfq_allot[] times there; the
+ * bottom level keeps it. Each run queue is kept sorted by level, and is
+ * round-robin within a level, so the head is always the most urgent.
+ */
+#define MLFQ_LEVELS 4
+static const unsigned mlfq_allot[MLFQ_LEVELS] = { 1, 2, 4, 0 };
+
+/*
+ * Put T on C's run queue behind everything at its level or above.
+ * Call with the run queue locked.
+ */
+static
+void
+runqueue_insert(struct cpu *c, struct thread *t)
+{
+	struct thread *t2;
+
+	//hogs sit at the tail, so they are the cheap ones to add
+	THREADLIST_FORALL_REV(t2, c->c_runqueue) {
+		if (t2->t_prio <= t->t_prio) {
+			threadlist_insertafter(&c->c_runqueue, t2, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+#define CPU_ALLOWED(t, c)  (((t)->t_affinity & CPUMASK((c)->c_number)) != 0)
+
+/*
+ * Find a cpu T may run on: an idle one if there is any, else the one
+ * with the fewest threads waiting, PREFER winning ties if T may run
+ * there. The other cpus are only peeked at, so this is a good guess
+ * rather than a promise. Sets *IDLE to say which kind it found.
+ */
+static
+struct cpu *
+thread_findcpu(struct thread *t, struct cpu *prefer, bool *idle)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus, count, bestcount;
+
+	best = NULL;
+	bestcount = 0;
+	if (prefer != NULL && CPU_ALLOWED(t, prefer)) {
+		best = prefer;
+		bestcount = prefer->c_runqueue.tl_count;
+	}
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == prefer || !CPU_ALLOWED(t, c)) {
+			continue;
+		}
+		if (c->c_isidle) {
+			*idle = true;
+			return c;
+		}
+		count = c->c_runqueue.tl_count;
+		if (best == NULL || count < bestcount) {
+			best = c;
+			bestcount = count;
+		}
+	}
+	//thread_set_affinity makes sure there's always somewhere
+	KASSERT(best != NULL);
+	*idle = false;
+	return best;
+}
+
+static bool thread_steal(void);
+
+#endif //OPT_A3
+
 /*
  * Make a thread runnable.
  *
@@ -450,7 +666,11 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
+#if OPT_A3
+	runqueue_insert(targetcpu, target);
+#else
 	threadlist_addtail(&targetcpu->c_runqueue, target);
+#endif //OPT_A3
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -464,6 +684,29 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+#if OPT_A3
+/*
+ * Put the thread thread_switch left in c_migrant on a cpu it is allowed
+ * on. Called on the way out of thread_switch, with the run queue
+ * unlocked, once we're off the migrant's stack.
+ */
+static
+void
+thread_placemigrant(void)
+{
+	struct thread *t;
+	bool idle;
+
+	t = curcpu->c_migrant;
+	if (t == NULL) {
+		return;
+	}
+	curcpu->c_migrant = NULL;
+	t->t_cpu = thread_findcpu(t, NULL, &idle);
+	thread_make_runnable(t, false);
+}
+#endif //OPT_A3
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -482,6 +725,9 @@ thread_fork(const char *name,
 {
 	struct thread *newthread;
 	int result;
+#if OPT_A3
+	bool isidle;
+#endif //OPT_A3
 
 #ifdef UW
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
@@ -506,6 +752,12 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+#if OPT_A3
+	newthread->t_affinity = curthread->t_affinity;
+	if (!CPU_ALLOWED(newthread, newthread->t_cpu)) {
+		newthread->t_cpu = thread_findcpu(newthread, NULL, &isidle);
+	}
+#endif //OPT_A3
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -574,7 +826,13 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
 	/* Micro-optimization: if nothing to do, just return */
+#if OPT_A3
+	//unless we may not stay here, or are the idle thread parking
+	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue) &&
+	    CPU_ALLOWED(cur, curcpu) && cur != curcpu->c_idlethread) {
+#else
 	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+#endif //OPT_A3
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -585,6 +843,23 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+#if OPT_A3
+		/* the idle thread sits out until it's needed again */
+		if (cur == curcpu->c_idlethread) {
+			break;
+		}
+		/*
+		 * Not allowed here any more. We can't go on another
+		 * cpu's run queue while still on our stack, so leave
+		 * ourselves for whoever runs next to place: the next
+		 * thread in the queue, or the idle thread if none.
+		 */
+		if (!CPU_ALLOWED(cur, curcpu)) {
+			KASSERT(curcpu->c_migrant == NULL);
+			curcpu->c_migrant = cur;
+			break;
+		}
+#endif //OPT_A3
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
@@ -633,9 +908,30 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
+#if OPT_A3
+		//the migrant's stack is no place to idle on
+		if (next == NULL && curcpu->c_migrant != NULL) {
+			KASSERT(curcpu->c_idlethread != NULL);
+			next = curcpu->c_idlethread;
+		}
+#endif //OPT_A3
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+#if OPT_A3
+			/*
+			 * Take work from a busy cpu, or failing that zero
+			 * some pages for later rather than just waiting.
+			 * If it comes to waiting, skip the hardclocks that
+			 * would find nothing to do.
+			 */
+			if (!thread_steal() && !vm_idle()) {
+				hardclock_idle();
+				cpu_idle();
+				hardclock_unidle();
+			}
+#else
 			cpu_idle();
+#endif //OPT_A3
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -708,6 +1004,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+#if OPT_A3
+	/* Send on the thread we switched away from, if it's leaving. */
+	thread_placemigrant();
+#endif //OPT_A3
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -741,6 +1042,11 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+#if OPT_A3
+	/* Send on the thread we switched away from, if it's leaving. */
+	thread_placemigrant();
+#endif //OPT_A3
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -829,12 +1135,296 @@ thread_yield(void)
 void
 schedule(void)
 {
+#if OPT_A3
+	struct thread *cur;
+
+	/*
+	 * Charge whoever is running for the hardclocks since the last
+	 * call; a thread that keeps getting caught is using its whole
+	 * time slice, so it drops below the ones that sleep. The run
+	 * queue needs no reshuffling, as runqueue_insert keeps it sorted
+	 * and hardclock is about to yield.
+	 */
+	if (curcpu->c_isidle) {
+		return;
+	}
+	cur = curthread;
+	cur->t_slices++;
+	if (cur->t_prio < MLFQ_LEVELS - 1 &&
+	    cur->t_slices >= mlfq_allot[cur->t_prio]) {
+		cur->t_prio++;
+		cur->t_slices = 0;
+	}
+#else
 	/*
 	 * You can write this. If we do nothing, threads will run in
 	 * round-robin fashion.
 	 */
+#endif //OPT_A3
+}
+
+#if OPT_A3
+void
+schedule_reset(void)
+{
+	struct thread *t;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	//the queue stays sorted, since everything on it is now level 0
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		t->t_prio = 0;
+		t->t_slices = 0;
+	}
+	if (!curcpu->c_isidle) {
+		curthread->t_prio = 0;
+		curthread->t_slices = 0;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+}
+
+/*
+ * A thread that slept wasn't using the CPU, so it moves up a level and
+ * starts a fresh allotment. Call before it's back on a run queue.
+ */
+static
+void
+thread_wakeboost(struct thread *t)
+{
+	if (t->t_prio > 0) {
+		t->t_prio--;
+	}
+	t->t_slices = 0;
+}
+
+/*
+ * Choose the cpu a woken thread should run on: its last one if that's
+ * idle, since its cache may still be warm; else any idle cpu, which
+ * thread_make_runnable will unidle; else the one with the fewest
+ * threads waiting, staying put on a tie. Only cpus in the thread's
+ * affinity mask count. Call before it's back on a run queue.
+ */
+static
+void
+thread_wakeplace(struct thread *target)
+{
+	struct cpu *last;
+	bool stuck, idle;
+	int spl;
+
+	spl = splhigh();
+	last = target->t_cpu;
+
+	/*
+	 * If LAST went idle right after TARGET went to sleep, it's still
+	 * on TARGET's stack, and TARGET has to go back there, even if its
+	 * mask no longer allows LAST: it leaves again at its next yield,
+	 * a hardclock later at most, which thread_switch never skips
+	 * for a thread that may not stay. Otherwise, once we hold the
+	 * lock, LAST has finished switching away from TARGET, and it's
+	 * free to move.
+	 */
+	spinlock_acquire(&last->c_runqueue_lock);
+	stuck = last->c_curthread == target;
+	idle = last->c_isidle;
+	spinlock_release(&last->c_runqueue_lock);
+	if (stuck || (idle && CPU_ALLOWED(target, last))) {
+		curcpu->c_wake_last++;
+		splx(spl);
+		return;
+	}
+
+	target->t_cpu = thread_findcpu(target, last, &idle);
+	if (idle) {
+		curcpu->c_wake_idle++;
+	}
+	else {
+		curcpu->c_wake_least++;
+	}
+	splx(spl);
+}
+#endif //OPT_A3
+
+#if OPT_A3
+
+/*
+ * Load balancing by work stealing.
+ *
+ * Each cpu keeps a decayed average of its own run queue length. A cpu
+ * that runs out of threads picks the other cpu with the highest
+ * average that has threads waiting, and takes half of them. Busy cpus
+ * never look at anybody else's run queue, and only the cpu doing the
+ * stealing and its victim take a lock.
+ */
+#define LOAD_ONE    256		/* c_loadavg of one waiting thread */
+#define LOAD_DECAY  8		/* each sample counts for 1/LOAD_DECAY */
+
+void
+thread_update_load(void)
+{
+	unsigned count;
+
+	//read without the lock; it only has to be about right
+	count = curcpu->c_runqueue.tl_count;
+	curcpu->c_loadavg = (curcpu->c_loadavg * (LOAD_DECAY - 1) +
+			     count * LOAD_ONE) / LOAD_DECAY;
+}
+
+void
+thread_idle_load(unsigned nticks)
+{
+	unsigned load;
+
+	load = curcpu->c_loadavg;
+	//after this many samples of 0 there's nothing left
+	if (nticks > LOAD_DECAY * 8) {
+		nticks = LOAD_DECAY * 8;
+	}
+	while (nticks-- > 0 && load > 0) {
+		load = load * (LOAD_DECAY - 1) / LOAD_DECAY;
+	}
+	curcpu->c_loadavg = load;
+}
+
+/*
+ * Called from the idle loop, with no run queue locked. Returns true if
+ * anything was moved onto our run queue.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct threadlist stolen;
+	struct thread *t, *prev;
+	unsigned i, n, want, numcpus;
+
+	victim = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		//unlocked peeks; the victim is checked again below
+		if (c == curcpu->c_self || c->c_isidle ||
+		    c->c_runqueue.tl_count == 0) {
+			continue;
+		}
+		if (victim == NULL || c->c_loadavg > victim->c_loadavg) {
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	threadlist_init(&stolen);
+	spinlock_acquire(&victim->c_runqueue_lock);
+	/*
+	 * An idle cpu is about to run what it has itself; it's also the
+	 * only case where its curthread can be on its run queue (see
+	 * thread_switch), which is why we mustn't take from it.
+	 */
+	want = victim->c_isidle ? 0 :
+		DIVROUNDUP(victim->c_runqueue.tl_count, 2);
+	n = 0;
+	//the tail holds the lowest levels, which lose least by moving
+	t = victim->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (n < want && t != NULL) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if (CPU_ALLOWED(t, curcpu)) {
+			KASSERT(t != victim->c_curthread);
+			threadlist_remove(&victim->c_runqueue, t);
+			t->t_cpu = curcpu->c_self;
+			threadlist_addhead(&stolen, t);
+			n++;
+		}
+		t = prev;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (n > 0) {
+		DEBUG(DB_THREADS, "Stole %u threads: cpu %u -> %u\n",
+		      n, victim->c_number, curcpu->c_number);
+		spinlock_acquire(&curcpu->c_runqueue_lock);
+		while ((t = threadlist_remhead(&stolen)) != NULL) {
+			runqueue_insert(curcpu->c_self, t);
+		}
+		spinlock_release(&curcpu->c_runqueue_lock);
+	}
+	threadlist_cleanup(&stolen);
+	return n > 0;
+}
+
+void
+thread_printstats(void)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	kprintf("cpu  loadavg  queued  wake:last   idle  least\n");
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%3u %5u.%02u %7u %10u %6u %6u\n", c->c_number,
+			c->c_loadavg / LOAD_ONE,
+			(c->c_loadavg % LOAD_ONE) * 100 / LOAD_ONE,
+			c->c_runqueue.tl_count, c->c_wake_last,
+			c->c_wake_idle, c->c_wake_least);
+	}
 }
 
+int
+thread_set_affinity(struct thread *t, uint32_t mask)
+{
+	struct cpu *c;
+	struct thread *t2;
+	unsigned numcpus;
+	uint32_t exists;
+	bool move, idle;
+
+	numcpus = cpuarray_num(&allcpus);
+	exists = numcpus >= 32 ? CPUMASK_ALL : CPUMASK(numcpus) - 1;
+	if ((mask & exists) == 0) {
+		return EINVAL;
+	}
+	t->t_affinity = mask;
+
+	if (t == curthread) {
+		//thread_switch hands us to a cpu we're allowed on
+		if (!CPU_ALLOWED(t, curcpu)) {
+			thread_yield();
+		}
+		return 0;
+	}
+
+	/* lock the run queue T is on, if any; it may be stolen meanwhile */
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+	move = false;
+	if (!CPU_ALLOWED(t, c) && c->c_curthread != t) {
+		THREADLIST_FORALL(t2, c->c_runqueue) {
+			if (t2 == t) {
+				threadlist_remove(&c->c_runqueue, t);
+				move = true;
+				break;
+			}
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+
+	if (move) {
+		t->t_cpu = thread_findcpu(t, NULL, &idle);
+		thread_make_runnable(t, false);
+	}
+	return 0;
+}
+
+#else
+
 /*
  * Thread migration.
  *
@@ -957,6 +1547,8 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+#endif //OPT_A3
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -971,17 +1563,65 @@ thread_consider_migration(void)
  * arrangements should be made to free it after the wait channel is
  * destroyed.
  */
+#if OPT_A3
+
+static struct kmem_cache *wchan_cache;
+
+/* kmem_cache constructor and destructor: an empty, unlocked channel */
+static
+int
+wchan_ctor(void *obj)
+{
+	struct wchan *wc = obj;
+
+	spinlock_init(&wc->wc_lock);
+	threadlist_init(&wc->wc_threads);
+	return 0;
+}
+
+static
+void
+wchan_dtor(void *obj)
+{
+	struct wchan *wc = obj;
+
+	spinlock_cleanup(&wc->wc_lock);
+	threadlist_cleanup(&wc->wc_threads);
+}
+
+void
+wchan_bootstrap(void)
+{
+	wchan_cache = kmem_cache_create("wchan", sizeof(struct wchan),
+					wchan_ctor, wchan_dtor);
+}
+
+void
+wchan_setname(struct wchan *wc, const char *name)
+{
+	wc->wc_name = name;
+}
+
+#endif //OPT_A3
+
 struct wchan *
 wchan_create(const char *name)
 {
 	struct wchan *wc;
 
+#if OPT_A3
+	wc = kmem_cache_alloc(wchan_cache);
+	if (wc == NULL) {
+		return NULL;
+	}
+#else
 	wc = kmalloc(sizeof(*wc));
 	if (wc == NULL) {
 		return NULL;
 	}
 	spinlock_init(&wc->wc_lock);
 	threadlist_init(&wc->wc_threads);
+#endif //OPT_A3
 	wc->wc_name = name;
 	return wc;
 }
@@ -993,9 +1633,16 @@ wchan_create(const char *name)
 void
 wchan_destroy(struct wchan *wc)
 {
+#if OPT_A3
+	//goes back to the cache empty and unlocked, as the ctor left it
+	KASSERT(threadlist_isempty(&wc->wc_threads));
+	KASSERT(!spinlock_do_i_hold(&wc->wc_lock));
+	kmem_cache_free(wchan_cache, wc);
+#else
 	spinlock_cleanup(&wc->wc_lock);
 	threadlist_cleanup(&wc->wc_threads);
 	kfree(wc);
+#endif //OPT_A3
 }
 
 /*
@@ -1050,9 +1697,31 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
+#if OPT_A3
+	thread_wakeboost(target);
+	thread_wakeplace(target);
+#endif //OPT_A3
 	thread_make_runnable(target, false);
 }
 
+#if OPT_A3
+/*
+ * Wake up thread T, which is sleeping on a wait channel.
+ */
+void
+wchan_wakethread(struct wchan *wc, struct thread *t)
+{
+	spinlock_acquire(&wc->wc_lock);
+	KASSERT(t->t_wchan_name == wc->wc_name);
+	threadlist_remove(&wc->wc_threads, t);
+	spinlock_release(&wc->wc_lock);
+
+	thread_wakeboost(t);
+	thread_wakeplace(t);
+	thread_make_runnable(t, false);
+}
+#endif //OPT_A3
+
 /*
  * Wake up all threads sleeping on a wait channel.
  */
@@ -1084,6 +1753,10 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+#if OPT_A3
+		thread_wakeboost(target);
+		thread_wakeplace(target);
+#endif //OPT_A3
 		thread_make_runnable(target, false);
 	}
 
@@ -1162,6 +1835,80 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+#if OPT_A3
+
+/*
+ * Queue MAPPING for cpu CPUNUM without interrupting it; it is acted on
+ * at the target's next shootdown IPI. Entries posted for the same cpu
+ * share one IPI. May be called with spinlocks held.
+ */
+void
+ipi_tlbshootdown_post(unsigned cpunum, const struct tlbshootdown *mapping)
+{
+	struct cpu *c;
+	int n;
+
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+	KASSERT(cpunum != curcpu->c_number);
+	c = cpuarray_get(&allcpus, cpunum);
+
+	spinlock_acquire(&c->c_ipi_lock);
+	n = c->c_numshootdown;
+	if (n == TLBSHOOTDOWN_MAX) {
+		c->c_numshootdown = TLBSHOOTDOWN_ALL;
+	}
+	else if (n != TLBSHOOTDOWN_ALL) {
+		c->c_shootdown[n] = *mapping;
+		c->c_numshootdown = n+1;
+	}
+	spinlock_release(&c->c_ipi_lock);
+}
+
+/*
+ * Interrupt every cpu in the bitmask TARGETS that still has shootdowns
+ * queued, then wait until all of them have acted on them.
+ */
+void
+ipi_tlbshootdown_wait(uint32_t targets)
+{
+	unsigned i, gen[MAXCPUS];
+	uint32_t sent;
+	struct cpu *c;
+
+	/* we may be about to wait on other cpus; they may be waiting on us */
+	KASSERT(curthread->t_curspl == 0);
+
+	//send them all first, so the targets work in parallel
+	sent = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		if (!(targets & ((uint32_t)1 << i))) {
+			continue;
+		}
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_ipi_lock);
+		//if the queue's empty, somebody's IPI already took care of ours
+		if (c->c_numshootdown != 0) {
+			gen[i] = c->c_shootdown_gen;
+			c->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
+			mainbus_send_ipi(c);
+			sent |= (uint32_t)1 << i;
+		}
+		spinlock_release(&c->c_ipi_lock);
+	}
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		if (!(sent & ((uint32_t)1 << i))) {
+			continue;
+		}
+		c = cpuarray_get(&allcpus, i);
+		while (c->c_shootdown_gen == gen[i]) {
+			/* spin; it's handled in the target's interrupt handler */
+		}
+	}
+}
+
+#endif //OPT_A3
+
 void
 interprocessor_interrupt(void)
 {
@@ -1202,6 +1949,9 @@ interprocessor_interrupt(void)
 			}
 		}
 		curcpu->c_numshootdown = 0;
+#if OPT_A3
+		curcpu->c_shootdown_gen++;
+#endif //OPT_A3
 	}
 
 	curcpu->c_ipi_pending = 0;
@@ -31,6 +31,18 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <vm.h>
+//ASST3
+#include <cpu.h>
+#include <current.h>
+#include <spl.h>
+#include <platform/maxcpus.h>
+#include "opt-A3.h"
+//ASST3
+
+#if OPT_KMALLOCPROF
+/* this is the real one; see kmalloc_prof */
+#undef kmalloc
+#endif
 
 /*
  * Kernel malloc.
@@ -138,6 +150,70 @@ struct pageref {
 #define NPAGEREFS (PAGE_SIZE / sizeof(struct pageref))
 static struct pageref pagerefs[NPAGEREFS];
 
+#if OPT_A3
+
+/*
+ * Not any more: the page above is only the first. When it runs out
+ * subpage_kmalloc gets another page of pagerefs from alloc_kpages, and
+ * so on. Pages of pagerefs are never given back. Free pagerefs are
+ * kept on a list, linked through next_samesize.
+ */
+
+static struct pageref *pageref_freelist;
+static unsigned pageref_total;	/* in all pages, for checksubpages */
+
+/*
+ * The tag (kpage_settag) on a page of subpage blocks is the address of
+ * its pageref, so a block's pageref and size are found without a
+ * search. Kernel addresses are far above the other kinds of tag, and
+ * those of midsize runs have the low bit set (see KTAG_MIDRUN).
+ */
+#define KTAG_SUB(pr)      ((unsigned)(vaddr_t)(pr))
+#define KTAG_ISSUB(t)     ((t) >= 0x100000 && ((t) & 1) == 0)
+#define KTAG_PAGEREF(t)   ((struct pageref *)(vaddr_t)(t))
+
+/* add the N pagerefs at PRS to the free list */
+static
+void
+addpagerefs(struct pageref *prs, unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		prs[i].next_samesize = pageref_freelist;
+		pageref_freelist = &prs[i];
+	}
+	pageref_total += n;
+}
+
+static
+struct pageref *
+allocpageref(void)
+{
+	struct pageref *pr;
+
+	if (pageref_total == 0) {
+		/* first use */
+		addpagerefs(pagerefs, NPAGEREFS);
+	}
+
+	pr = pageref_freelist;
+	if (pr != NULL) {
+		pageref_freelist = pr->next_samesize;
+	}
+	return pr;
+}
+
+static
+void
+freepageref(struct pageref *p)
+{
+	p->next_samesize = pageref_freelist;
+	pageref_freelist = p;
+}
+
+#else
+
 #define INUSE_WORDS (NPAGEREFS/32)
 static uint32_t pagerefs_inuse[INUSE_WORDS];
 
@@ -181,6 +257,8 @@ freepageref(struct pageref *p)
 	pagerefs_inuse[i] &= ~k;
 }
 
+#endif //OPT_A3
+
 ////////////////////////////////////////
 
 static struct pageref *sizebases[NSIZES];
@@ -260,14 +338,22 @@ checksubpages(void)
 	for (i=0; i<NSIZES; i++) {
 		for (pr = sizebases[i]; pr != NULL; pr = pr->next_samesize) {
 			checksubpage(pr);
+#if OPT_A3
+			KASSERT(sc < pageref_total);
+#else
 			KASSERT(sc < NPAGEREFS);
+#endif //OPT_A3
 			sc++;
 		}
 	}
 
 	for (pr = allbase; pr != NULL; pr = pr->next_all) {
 		checksubpage(pr);
+#if OPT_A3
+		KASSERT(ac < pageref_total);
+#else
 		KASSERT(ac < NPAGEREFS);
+#endif //OPT_A3
 		ac++;
 	}
 
@@ -330,11 +416,21 @@ dumpsubpage(struct pageref *pr)
 	kprintf("\n");
 }
 
+#if OPT_A3
+static void magazine_printstats(void);
+static void bigblock_printstats(void);
+#endif //OPT_A3
+
 void
 kheap_printstats(void)
 {
 	struct pageref *pr;
 
+#if OPT_A3
+	magazine_printstats();
+	bigblock_printstats();
+#endif //OPT_A3
+
 	/* print the whole thing with interrupts off */
 	spinlock_acquire(&kmalloc_spinlock);
 
@@ -402,6 +498,9 @@ subpage_kmalloc(size_t sz)
 	vaddr_t fla;		// free list entry address
 	struct freelist *volatile fl;	// free list entry
 	void *retptr;		// our result
+#if OPT_A3
+	vaddr_t refpage;	// new page of pagerefs, if we run out
+#endif //OPT_A3
 
 	volatile int i;
 
@@ -469,6 +568,18 @@ subpage_kmalloc(size_t sz)
 	spinlock_acquire(&kmalloc_spinlock);
 
 	pr = allocpageref();
+#if OPT_A3
+	if (pr == NULL) {
+		/* out of pagerefs: get a page of new ones, also unlocked */
+		spinlock_release(&kmalloc_spinlock);
+		refpage = alloc_kpages(1);
+		spinlock_acquire(&kmalloc_spinlock);
+		if (refpage != 0) {
+			addpagerefs((struct pageref *)refpage, NPAGEREFS);
+			pr = allocpageref();
+		}
+	}
+#endif //OPT_A3
 	if (pr==NULL) {
 		/* Couldn't allocate accounting space for the new page. */
 		spinlock_release(&kmalloc_spinlock);
@@ -504,6 +615,10 @@ subpage_kmalloc(size_t sz)
 	pr->next_all = allbase;
 	allbase = pr;
 
+#if OPT_A3
+	kpage_settag(prpage, KTAG_SUB(pr));
+#endif //OPT_A3
+
 	/* This is kind of cheesy, but avoids duplicating the alloc code. */
 	goto doalloc;
 }
@@ -578,6 +693,9 @@ subpage_kfree(void *ptr)
 		/* Whole page is free. */
 		remove_lists(pr, blktype);
 		freepageref(pr);
+#if OPT_A3
+		kpage_settag(prpage, 0);
+#endif //OPT_A3
 		/* Call free_kpages without kmalloc_spinlock. */
 		spinlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
@@ -595,6 +713,844 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+#if OPT_A3
+
+////////////////////////////////////////////////////////////
+//
+// Per-cpu magazines.
+//
+// Each cpu keeps a short stack of free blocks of each size, its
+// magazine, which kmalloc and kfree use with interrupts off and without
+// taking kmalloc_spinlock. Only when a magazine runs empty or fills up
+// does the cpu go to the pages, under the lock, and then it moves half
+// a magazine of blocks in one trip.
+//
+// kfree gets a block's pageref, and so its size, from the tag
+// subpage_kmalloc leaves on the page (kpage_settag) instead of
+// searching the page list, which would need the lock. Untagged pages, from before the VM system was up, are
+// freed the old way.
+//
+// As far as the pages are concerned, blocks in magazines are still
+// allocated, so a page with any of them in it is never given back.
+// Magazines for the bigger sizes are short to limit what can be
+// stranded that way.
+//
+
+#define MAGAZINE_MAX 16
+static const unsigned magsizes[NSIZES] = { 16, 16, 16, 8, 8, 4, 2, 2 };
+
+struct magazine {
+	unsigned nblocks;
+	void *blocks[MAGAZINE_MAX];
+};
+
+struct kmalloc_cpu {
+	struct magazine mags[NSIZES];
+	unsigned allochits;	/* kmallocs served from a magazine */
+	unsigned freehits;	/* kfrees that went into one */
+	unsigned refills;	/* trips to the pages for more blocks */
+	unsigned drains;	/* trips to the pages to give some back */
+};
+
+/* only touched by their own cpu, with interrupts off */
+static struct kmalloc_cpu kmalloc_cpus[MAXCPUS];
+
+/* take the first free block off PR's page; call with the lock held */
+static
+void *
+subpage_pop(struct pageref *pr)
+{
+	vaddr_t prpage;
+	struct freelist *fl;
+
+	KASSERT(pr->nfree > 0);
+	KASSERT(pr->freelist_offset < PAGE_SIZE);
+	prpage = PR_PAGEADDR(pr);
+	fl = (struct freelist *)(prpage + pr->freelist_offset);
+	pr->nfree--;
+	if (fl->next != NULL) {
+		KASSERT(pr->nfree > 0);
+		KASSERT((vaddr_t)fl->next - prpage < PAGE_SIZE);
+		pr->freelist_offset = (vaddr_t)fl->next - prpage;
+	}
+	else {
+		KASSERT(pr->nfree == 0);
+		pr->freelist_offset = INVALID_OFFSET;
+	}
+	return fl;
+}
+
+/*
+ * Take up to N free blocks of type BLKTYPE from the pages. If there
+ * are none, subpage_kmalloc adds a page and we make do with one block.
+ * Returns how many we got; 0 means out of memory.
+ */
+static
+unsigned
+subpage_getblocks(unsigned blktype, void **blocks, unsigned n)
+{
+	struct pageref *pr;
+	unsigned got;
+
+	got = 0;
+	spinlock_acquire(&kmalloc_spinlock);
+	checksubpages();
+	for (pr = sizebases[blktype]; pr != NULL && got < n;
+	     pr = pr->next_samesize) {
+		KASSERT(PR_BLOCKTYPE(pr) == blktype);
+		while (pr->nfree > 0 && got < n) {
+			blocks[got++] = subpage_pop(pr);
+		}
+	}
+	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
+
+	if (got == 0) {
+		blocks[0] = subpage_kmalloc(sizes[blktype]);
+		if (blocks[0] != NULL) {
+			got = 1;
+		}
+	}
+	return got;
+}
+
+#ifdef SLOW
+/* make sure the block at PTRADDR isn't already on PR's free list */
+static
+void
+checknotfree(struct pageref *pr, vaddr_t ptraddr)
+{
+	struct freelist *fl;
+
+	if (pr->freelist_offset == INVALID_OFFSET) {
+		return;
+	}
+	fl = (struct freelist *)(PR_PAGEADDR(pr) + pr->freelist_offset);
+	for (; fl != NULL; fl = fl->next) {
+		if ((vaddr_t)fl == ptraddr) {
+			panic("kfree: block %p freed twice\n", fl);
+		}
+	}
+}
+#else
+#define checknotfree(pr, ptraddr) ((void)(pr), (void)(ptraddr))
+#endif
+
+/*
+ * Return N blocks of type BLKTYPE to their pages, which must be tagged,
+ * and give back any page that ends up completely free.
+ */
+static
+void
+subpage_putblocks(unsigned blktype, void **blocks, unsigned n)
+{
+	struct pageref *pr;
+	struct freelist *fl;
+	vaddr_t ptraddr, prpage, offset;
+	vaddr_t freed[MAGAZINE_MAX];
+	unsigned i, nfreed, tag;
+
+	KASSERT(n <= MAGAZINE_MAX);
+	nfreed = 0;
+
+	spinlock_acquire(&kmalloc_spinlock);
+	checksubpages();
+	for (i=0; i<n; i++) {
+		ptraddr = (vaddr_t)blocks[i];
+		prpage = ptraddr & PAGE_FRAME;
+		tag = kpage_gettag(prpage);
+		KASSERT(KTAG_ISSUB(tag));
+		pr = KTAG_PAGEREF(tag);
+
+		/* the same checks subpage_kfree makes */
+		KASSERT(PR_PAGEADDR(pr) == prpage);
+		KASSERT(PR_BLOCKTYPE(pr) == blktype);
+		checksubpage(pr);
+		offset = ptraddr - prpage;
+		if (offset % sizes[blktype] != 0) {
+			panic("kfree: subpage free of invalid addr %p\n",
+			      blocks[i]);
+		}
+		if (pr->freelist_offset == offset) {
+			panic("kfree: block %p freed twice\n", blocks[i]);
+		}
+		checknotfree(pr, ptraddr);
+
+		fl = blocks[i];
+		if (pr->freelist_offset == INVALID_OFFSET) {
+			fl->next = NULL;
+		}
+		else {
+			fl->next = (struct freelist *)(prpage +
+						       pr->freelist_offset);
+		}
+		pr->freelist_offset = offset;
+		pr->nfree++;
+
+		KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
+		if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
+			remove_lists(pr, blktype);
+			freepageref(pr);
+			kpage_settag(prpage, 0);
+			freed[nfreed++] = prpage;
+		}
+	}
+	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
+
+	/* Call free_kpages without kmalloc_spinlock. */
+	for (i=0; i<nfreed; i++) {
+		free_kpages(freed[i]);
+	}
+}
+
+static
+void *
+magazine_kmalloc(size_t sz)
+{
+	struct kmalloc_cpu *kc;
+	struct magazine *mag;
+	void *blocks[MAGAZINE_MAX];
+	void *ret;
+	unsigned blktype, n;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		return subpage_kmalloc(sz);
+	}
+	blktype = blocktype(sz);
+
+	spl = splhigh();
+	kc = &kmalloc_cpus[curcpu->c_number];
+	mag = &kc->mags[blktype];
+	if (mag->nblocks > 0) {
+		ret = mag->blocks[--mag->nblocks];
+		kc->allochits++;
+		splx(spl);
+		return ret;
+	}
+	kc->refills++;
+	splx(spl);
+
+	/* empty: fetch half a magazine, keep one and stash the rest */
+	n = subpage_getblocks(blktype, blocks, (magsizes[blktype] + 1) / 2);
+	if (n == 0) {
+		return NULL;
+	}
+	ret = blocks[--n];
+
+	spl = splhigh();
+	/* we may have moved cpus meanwhile; any magazine will do */
+	mag = &kmalloc_cpus[curcpu->c_number].mags[blktype];
+	while (n > 0 && mag->nblocks < magsizes[blktype]) {
+		mag->blocks[mag->nblocks++] = blocks[--n];
+	}
+	splx(spl);
+
+	if (n > 0) {
+		subpage_putblocks(blktype, blocks, n);
+	}
+	return ret;
+}
+
+/* Returns -1 if PTR isn't on a tagged page, like subpage_kfree. */
+static
+int
+magazine_kfree(void *ptr)
+{
+	struct kmalloc_cpu *kc;
+	struct magazine *mag;
+	void *blocks[MAGAZINE_MAX];
+	unsigned tag, blktype, n, i;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		return -1;
+	}
+	tag = kpage_gettag((vaddr_t)ptr & PAGE_FRAME);
+	if (!KTAG_ISSUB(tag)) {
+		return -1;
+	}
+	//the page can't go away while PTR is allocated, so no lock
+	blktype = PR_BLOCKTYPE(KTAG_PAGEREF(tag));
+	KASSERT(blktype < NSIZES);
+
+	if (((vaddr_t)ptr & ~PAGE_FRAME) % sizes[blktype] != 0) {
+		panic("kfree: subpage free of invalid addr %p\n", ptr);
+	}
+	fill_deadbeef(ptr, sizes[blktype]);
+
+	n = 0;
+	spl = splhigh();
+	kc = &kmalloc_cpus[curcpu->c_number];
+	mag = &kc->mags[blktype];
+	for (i=0; i<mag->nblocks; i++) {
+		if (mag->blocks[i] == ptr) {
+			panic("kfree: block %p freed twice\n", ptr);
+		}
+	}
+	if (mag->nblocks == magsizes[blktype]) {
+		/* full: the oldest half goes back, the hot ones stay */
+		n = magsizes[blktype] / 2;
+		for (i=0; i<n; i++) {
+			blocks[i] = mag->blocks[i];
+		}
+		for (i=n; i<mag->nblocks; i++) {
+			mag->blocks[i-n] = mag->blocks[i];
+		}
+		mag->nblocks -= n;
+		kc->drains++;
+	}
+	else {
+		kc->freehits++;
+	}
+	mag->blocks[mag->nblocks++] = ptr;
+	splx(spl);
+
+	if (n > 0) {
+		subpage_putblocks(blktype, blocks, n);
+	}
+	return 0;
+}
+
+static
+void
+magazine_printstats(void)
+{
+	struct kmalloc_cpu *kc;
+	unsigned i, j, cached;
+
+	kprintf("Per-cpu magazines:\n");
+	for (i=0; i<MAXCPUS; i++) {
+		kc = &kmalloc_cpus[i];
+		if (kc->allochits + kc->refills + kc->freehits == 0) {
+			continue;
+		}
+		cached = 0;
+		for (j=0; j<NSIZES; j++) {
+			cached += kc->mags[j].nblocks;
+		}
+		kprintf("cpu%u: %u local allocs, %u refills, "
+			"%u local frees, %u drains, %u blocks cached\n",
+			i, kc->allochits, kc->refills, kc->freehits,
+			kc->drains, cached);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Bigger allocations.
+//
+// Past LARGEST_SUBPAGE_SIZE everything used to be rounded up to whole
+// pages. Sizes that waste a lot that way now come from runs of
+// MIDRUN_PAGES pages cut into equal blocks: 3k blocks go four to a run
+// instead of a page each, 6k blocks two to a run instead of two pages
+// each. The blocks fill a run exactly, so its header is kmalloc'd on
+// the side.
+//
+// Everything else is a run of whole pages. Recently freed runs are
+// kept, up to RUNCACHE_PAGES pages in all, and handed straight back to
+// the next request for the same length instead of going through the
+// coremap again. If alloc_kpages fails the cache is given back and the
+// allocation retried.
+//
+// kfree tells these apart by their page tags. Before the VM system is
+// up pages can't be tagged; a midsize request then gets a whole run to
+// itself, which kfree gives back like any untagged allocation.
+//
+
+/*
+ * Page tags besides the subpage ones (KTAG_SUB): every page of a midsize
+ * run carries the address of its struct midrun, with the low bit set to
+ * tell it from a pageref, and the first page of a run of whole pages
+ * carries its length.
+ */
+#define KTAG_MIDRUN(mr)   ((unsigned)(vaddr_t)(mr) | 1)
+#define KTAG_ISMID(t)     ((t) >= 0x100000 && ((t) & 1) != 0)
+#define KTAG_MIDRUNPTR(t) ((struct midrun *)(vaddr_t)((t) & ~1U))
+#define KTAG_RUN(n)       (0x10000 | (n))
+#define KTAG_ISRUN(t)     (((t) & ~0xffffU) == 0x10000)
+#define KTAG_RUNPAGES(t)  ((t) & 0xffff)
+
+#define MIDRUN_PAGES 3
+#define NMIDSIZES 2
+static const size_t midsizes[NMIDSIZES] = { 3072, 6144 };
+
+struct midrun {
+	vaddr_t mr_addr;
+	unsigned mr_size;		/* index into midsizes */
+	struct freelist *mr_free;
+	unsigned mr_nfree;
+	struct midrun *mr_next, *mr_prev;	/* for midsize_kmalloc */
+};
+
+#define RUNCACHE_MAXRUN 16	/* longest run worth keeping, in pages */
+#define RUNCACHE_PAGES  32	/* most pages kept in all */
+
+/* all covered by kmalloc_spinlock */
+static struct midrun *midruns[NMIDSIZES];
+static struct freelist *runcache[RUNCACHE_MAXRUN + 1];
+static unsigned runcache_pages;
+static unsigned runcache_hits, runcache_misses;
+
+/* give every cached run back to the coremap; returns how many pages */
+static
+unsigned
+run_flush(void)
+{
+	struct freelist *fl;
+	unsigned npages, total;
+
+	total = 0;
+	for (npages = 1; npages <= RUNCACHE_MAXRUN; npages++) {
+		while (1) {
+			spinlock_acquire(&kmalloc_spinlock);
+			fl = runcache[npages];
+			if (fl == NULL) {
+				spinlock_release(&kmalloc_spinlock);
+				break;
+			}
+			runcache[npages] = fl->next;
+			runcache_pages -= npages;
+			spinlock_release(&kmalloc_spinlock);
+			free_kpages((vaddr_t)fl);
+			total += npages;
+		}
+	}
+	return total;
+}
+
+/* NPAGES contiguous pages, a recently freed run if there is one */
+static
+vaddr_t
+run_alloc(unsigned npages)
+{
+	struct freelist *fl;
+	vaddr_t addr;
+
+	if (npages <= RUNCACHE_MAXRUN) {
+		spinlock_acquire(&kmalloc_spinlock);
+		fl = runcache[npages];
+		if (fl != NULL) {
+			runcache[npages] = fl->next;
+			runcache_pages -= npages;
+			runcache_hits++;
+			spinlock_release(&kmalloc_spinlock);
+			return (vaddr_t)fl;
+		}
+		runcache_misses++;
+		spinlock_release(&kmalloc_spinlock);
+	}
+
+	addr = alloc_kpages(npages);
+	if (addr == 0 && run_flush() > 0) {
+		addr = alloc_kpages(npages);
+	}
+	return addr;
+}
+
+/* take back a run from run_alloc, keeping it if there's room */
+static
+void
+run_free(vaddr_t addr, unsigned npages)
+{
+	struct freelist *fl;
+
+	if (npages <= RUNCACHE_MAXRUN) {
+		spinlock_acquire(&kmalloc_spinlock);
+		if (runcache_pages + npages <= RUNCACHE_PAGES) {
+			fl = (struct freelist *)addr;
+			fl->next = runcache[npages];
+			runcache[npages] = fl;
+			runcache_pages += npages;
+			spinlock_release(&kmalloc_spinlock);
+			return;
+		}
+		spinlock_release(&kmalloc_spinlock);
+	}
+	free_kpages(addr);
+}
+
+/* take the first free block off MR; call with the lock held */
+static
+void *
+midrun_pop(struct midrun *mr)
+{
+	struct freelist *fl;
+
+	KASSERT(mr->mr_nfree > 0);
+	fl = mr->mr_free;
+	mr->mr_free = fl->next;
+	mr->mr_nfree--;
+	return fl;
+}
+
+static
+void *
+midsize_kmalloc(unsigned m)
+{
+	struct midrun *mr;
+	struct freelist *fl;
+	vaddr_t addr;
+	unsigned i, n;
+	void *ret;
+
+	spinlock_acquire(&kmalloc_spinlock);
+	for (mr = midruns[m]; mr != NULL; mr = mr->mr_next) {
+		if (mr->mr_nfree > 0) {
+			ret = midrun_pop(mr);
+			spinlock_release(&kmalloc_spinlock);
+			return ret;
+		}
+	}
+	spinlock_release(&kmalloc_spinlock);
+
+	/* none free: cut up a new run, without the lock */
+	addr = run_alloc(MIDRUN_PAGES);
+	if (addr == 0) {
+		return NULL;
+	}
+	kpage_settag(addr, KTAG_RUN(MIDRUN_PAGES));
+	if (kpage_gettag(addr) != KTAG_RUN(MIDRUN_PAGES)) {
+		/* too early for tags; see above */
+		return (void *)addr;
+	}
+	mr = kmalloc(sizeof(struct midrun));
+	if (mr == NULL) {
+		kpage_settag(addr, 0);
+		run_free(addr, MIDRUN_PAGES);
+		return NULL;
+	}
+	for (i=0; i<MIDRUN_PAGES; i++) {
+		kpage_settag(addr + i*PAGE_SIZE, KTAG_MIDRUN(mr));
+	}
+
+	n = MIDRUN_PAGES * PAGE_SIZE / midsizes[m];
+	mr->mr_addr = addr;
+	mr->mr_size = m;
+	mr->mr_free = NULL;
+	for (i=n; i-- > 0; ) {
+		fl = (struct freelist *)(addr + i*midsizes[m]);
+		fl->next = mr->mr_free;
+		mr->mr_free = fl;
+	}
+	mr->mr_nfree = n;
+
+	spinlock_acquire(&kmalloc_spinlock);
+	mr->mr_prev = NULL;
+	mr->mr_next = midruns[m];
+	if (mr->mr_next != NULL) {
+		mr->mr_next->mr_prev = mr;
+	}
+	midruns[m] = mr;
+	ret = midrun_pop(mr);
+	spinlock_release(&kmalloc_spinlock);
+	return ret;
+}
+
+static
+void
+midsize_kfree(void *ptr, unsigned tag)
+{
+	struct midrun *mr;
+	struct freelist *fl;
+	vaddr_t addr;
+	unsigned m, i;
+
+	//the run can't go away while PTR is allocated, so no lock yet
+	mr = KTAG_MIDRUNPTR(tag);
+	m = mr->mr_size;
+	KASSERT(m < NMIDSIZES);
+	addr = mr->mr_addr;
+	KASSERT((vaddr_t)ptr >= addr &&
+		(vaddr_t)ptr < addr + MIDRUN_PAGES * PAGE_SIZE);
+	if (((vaddr_t)ptr - addr) % midsizes[m] != 0) {
+		panic("kfree: midsize free of invalid addr %p\n", ptr);
+	}
+	fill_deadbeef(ptr, midsizes[m]);
+
+	spinlock_acquire(&kmalloc_spinlock);
+	fl = ptr;
+	fl->next = mr->mr_free;
+	mr->mr_free = fl;
+	mr->mr_nfree++;
+	if (mr->mr_nfree < MIDRUN_PAGES * PAGE_SIZE / midsizes[m]) {
+		spinlock_release(&kmalloc_spinlock);
+		return;
+	}
+
+	/* all free: the run goes back */
+	if (mr->mr_prev != NULL) {
+		mr->mr_prev->mr_next = mr->mr_next;
+	}
+	else {
+		midruns[m] = mr->mr_next;
+	}
+	if (mr->mr_next != NULL) {
+		mr->mr_next->mr_prev = mr->mr_prev;
+	}
+	spinlock_release(&kmalloc_spinlock);
+	for (i=0; i<MIDRUN_PAGES; i++) {
+		kpage_settag(addr + i*PAGE_SIZE, 0);
+	}
+	run_free(addr, MIDRUN_PAGES);
+	kfree(mr);
+}
+
+static
+void *
+bigblock_kmalloc(size_t sz)
+{
+	unsigned m, npages;
+	vaddr_t addr;
+
+	/* a midsize block, if it's smaller than the pages it'd round to */
+	for (m=0; m<NMIDSIZES; m++) {
+		if (sz <= midsizes[m] &&
+		    midsizes[m] < ROUNDUP(sz, PAGE_SIZE)) {
+			return midsize_kmalloc(m);
+		}
+	}
+
+	npages = DIVROUNDUP(sz, PAGE_SIZE);
+	addr = run_alloc(npages);
+	if (addr == 0) {
+		return NULL;
+	}
+	kpage_settag(addr, KTAG_RUN(npages));
+	return (void *)addr;
+}
+
+/* Returns -1 if PTR isn't from bigblock_kmalloc, like subpage_kfree. */
+static
+int
+bigblock_kfree(void *ptr)
+{
+	unsigned tag;
+
+	tag = kpage_gettag((vaddr_t)ptr & PAGE_FRAME);
+	if (KTAG_ISMID(tag)) {
+		midsize_kfree(ptr, tag);
+		return 0;
+	}
+	if (KTAG_ISRUN(tag)) {
+		KASSERT((vaddr_t)ptr % PAGE_SIZE == 0);
+		kpage_settag((vaddr_t)ptr, 0);
+		run_free((vaddr_t)ptr, KTAG_RUNPAGES(tag));
+		return 0;
+	}
+	return -1;
+}
+
+static
+void
+bigblock_printstats(void)
+{
+	struct midrun *mr;
+	unsigned m, nruns, nfree;
+
+	spinlock_acquire(&kmalloc_spinlock);
+	for (m=0; m<NMIDSIZES; m++) {
+		nruns = nfree = 0;
+		for (mr = midruns[m]; mr != NULL; mr = mr->mr_next) {
+			nruns++;
+			nfree += mr->mr_nfree;
+		}
+		kprintf("size %-4lu: %u runs of %u pages, %u/%u free\n",
+			(unsigned long)midsizes[m], nruns, MIDRUN_PAGES, nfree,
+			nruns * MIDRUN_PAGES * PAGE_SIZE / midsizes[m]);
+	}
+	kprintf("Run cache: %u pages kept, %u hits, %u misses\n",
+		runcache_pages, runcache_hits, runcache_misses);
+	spinlock_release(&kmalloc_spinlock);
+}
+
+#endif //OPT_A3
+
+#if OPT_KMALLOCPROF
+
+////////////////////////////////////////////////////////////
+//
+// Per-callsite accounting.
+//
+// Each callsite gets a record the first time it allocates, and each
+// allocation it has outstanding is found from its pointer through a
+// hash table, so kfree knows whom to credit. Both come from fixed
+// arrays, so keeping track never allocates anything; allocations made
+// when either is full are only counted as untracked.
+//
+
+#define PROF_NSITES    256	/* callsites, open hashed by line */
+#define PROF_NLIVE     4096	/* outstanding allocations tracked */
+#define PROF_NBUCKETS  1024
+#define PROF_NTOP      20	/* lines kmalloc_printprofile prints */
+
+struct prof_site {
+	const char *ps_file;	/* NULL if unused */
+	int ps_line;
+	size_t ps_bytes;	/* outstanding */
+	size_t ps_peak;
+	unsigned ps_live;	/* outstanding allocations */
+	unsigned ps_allocs;	/* ever */
+};
+
+struct prof_live {
+	const void *pl_ptr;
+	size_t pl_size;
+	struct prof_site *pl_site;
+	struct prof_live *pl_next;	/* in its bucket, or free */
+};
+
+static struct spinlock prof_lock = SPINLOCK_INITIALIZER;
+static struct prof_site prof_sites[PROF_NSITES];
+static struct prof_live prof_live[PROF_NLIVE];
+static struct prof_live *prof_buckets[PROF_NBUCKETS];
+static struct prof_live *prof_freelive;
+static unsigned prof_nlive;		/* prof_live[] entries used so far */
+static unsigned prof_untracked;
+
+#define PROF_HASH(ptr)  ((((vaddr_t)(ptr)) >> 3) % PROF_NBUCKETS)
+
+/* find or make FILE:LINE's record; NULL if there's no room */
+static
+struct prof_site *
+prof_getsite(const char *file, int line)
+{
+	struct prof_site *ps;
+	unsigned i;
+
+	for (i=0; i<PROF_NSITES; i++) {
+		ps = &prof_sites[((unsigned)line + i) % PROF_NSITES];
+		if (ps->ps_file == NULL) {
+			ps->ps_file = file;
+			ps->ps_line = line;
+			return ps;
+		}
+		if (ps->ps_line == line && strcmp(ps->ps_file, file) == 0) {
+			return ps;
+		}
+	}
+	return NULL;
+}
+
+void *
+kmalloc_prof(size_t size, const char *file, int line)
+{
+	struct prof_site *ps;
+	struct prof_live *pl;
+	void *ptr;
+	unsigned b;
+
+	ptr = kmalloc(size);
+	if (ptr == NULL) {
+		return NULL;
+	}
+
+	spinlock_acquire(&prof_lock);
+	ps = prof_getsite(file, line);
+	pl = prof_freelive;
+	if (pl != NULL) {
+		prof_freelive = pl->pl_next;
+	}
+	else if (prof_nlive < PROF_NLIVE) {
+		pl = &prof_live[prof_nlive++];
+	}
+	if (ps == NULL || pl == NULL) {
+		if (pl != NULL) {
+			pl->pl_next = prof_freelive;
+			prof_freelive = pl;
+		}
+		prof_untracked++;
+		spinlock_release(&prof_lock);
+		return ptr;
+	}
+
+	ps->ps_allocs++;
+	ps->ps_live++;
+	ps->ps_bytes += size;
+	if (ps->ps_bytes > ps->ps_peak) {
+		ps->ps_peak = ps->ps_bytes;
+	}
+	pl->pl_ptr = ptr;
+	pl->pl_size = size;
+	pl->pl_site = ps;
+	b = PROF_HASH(ptr);
+	pl->pl_next = prof_buckets[b];
+	prof_buckets[b] = pl;
+	spinlock_release(&prof_lock);
+
+	return ptr;
+}
+
+/*
+ * Credit PTR's callsite, if it was tracked. Called by kfree before the
+ * block is really freed, while nobody else can have been given PTR.
+ */
+static
+void
+prof_forget(const void *ptr)
+{
+	struct prof_live *pl, **pp;
+
+	spinlock_acquire(&prof_lock);
+	for (pp = &prof_buckets[PROF_HASH(ptr)]; *pp != NULL;
+	     pp = &(*pp)->pl_next) {
+		pl = *pp;
+		if (pl->pl_ptr == ptr) {
+			*pp = pl->pl_next;
+			KASSERT(pl->pl_site->ps_live > 0);
+			pl->pl_site->ps_live--;
+			pl->pl_site->ps_bytes -= pl->pl_size;
+			pl->pl_next = prof_freelive;
+			prof_freelive = pl;
+			break;
+		}
+	}
+	spinlock_release(&prof_lock);
+}
+
+void
+kmalloc_printprofile(void)
+{
+	struct prof_site *top[PROF_NTOP];
+	struct prof_site *ps;
+	unsigned i, j, ntop;
+
+	spinlock_acquire(&prof_lock);
+
+	/* the PROF_NTOP sites with the most outstanding, biggest first */
+	ntop = 0;
+	for (i=0; i<PROF_NSITES; i++) {
+		ps = &prof_sites[i];
+		if (ps->ps_file == NULL) {
+			continue;
+		}
+		if (ntop == PROF_NTOP && top[ntop-1]->ps_bytes >= ps->ps_bytes) {
+			continue;
+		}
+		j = ntop < PROF_NTOP ? ntop++ : ntop - 1;
+		while (j > 0 && top[j-1]->ps_bytes < ps->ps_bytes) {
+			top[j] = top[j-1];
+			j--;
+		}
+		top[j] = ps;
+	}
+
+	kprintf("%8s %6s %8s %8s  %s\n", "bytes", "live", "peak", "allocs",
+		"callsite");
+	for (i=0; i<ntop; i++) {
+		kprintf("%8lu %6u %8lu %8u  %s:%d\n",
+			(unsigned long)top[i]->ps_bytes, top[i]->ps_live,
+			(unsigned long)top[i]->ps_peak, top[i]->ps_allocs,
+			top[i]->ps_file, top[i]->ps_line);
+	}
+	kprintf("%u allocations not tracked\n", prof_untracked);
+
+	spinlock_release(&prof_lock);
+}
+
+#endif /* OPT_KMALLOCPROF */
+
 //
 ////////////////////////////////////////////////////////////
 
@@ -602,6 +1558,9 @@ void *
 kmalloc(size_t sz)
 {
 	if (sz>=LARGEST_SUBPAGE_SIZE) {
+#if OPT_A3
+		return bigblock_kmalloc(sz);
+#else
 		unsigned long npages;
 		vaddr_t address;
 
@@ -613,20 +1572,37 @@ kmalloc(size_t sz)
 		}
 
 		return (void *)address;
+#endif //OPT_A3
 	}
 
+#if OPT_A3
+	return magazine_kmalloc(sz);
+#else
 	return subpage_kmalloc(sz);
+#endif //OPT_A3
 }
 
 void
 kfree(void *ptr)
 {
+#if OPT_KMALLOCPROF
+	if (ptr != NULL) {
+		prof_forget(ptr);
+	}
+#endif
+
 	/*
 	 * Try subpage first; if that fails, assume it's a big allocation.
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+#if OPT_A3
+	else if (magazine_kfree(ptr) == 0 || bigblock_kfree(ptr) == 0) {
+		return;
+	}
+#endif //OPT_A3
+	else if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
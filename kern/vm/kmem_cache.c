@@ -0,0 +1,305 @@
+/*
+ * Slab caches of constructed objects. See kmem_cache.h for details.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <kmem_cache.h>
+
+/*
+ * A slab is one page: this header, then the objects, each behind a
+ * bufctl that links it into the slab's free list while it's free. The
+ * object itself is never written by the cache, since it's constructed.
+ */
+struct kmem_bufctl {
+	struct kmem_bufctl *kb_next;
+};
+
+/* keep objects 8-byte aligned, like kmalloc does */
+#define KMEM_ALIGN    8
+#define KMEM_HDRSIZE  ROUNDUP(sizeof(struct kmem_bufctl), KMEM_ALIGN)
+#define KMEM_SLABHDR  ROUNDUP(sizeof(struct kmem_slab), KMEM_ALIGN)
+
+struct kmem_slab {
+	struct kmem_cache *ks_cache;
+	struct kmem_slab *ks_next;	/* on the cache's list, unless full */
+	struct kmem_slab *ks_prev;
+	struct kmem_bufctl *ks_free;	/* free objects */
+	unsigned ks_nfree;
+	bool ks_stolen;			/* from before vm_bootstrap; kept */
+};
+
+struct kmem_cache {
+	const char *kc_name;
+	size_t kc_bufsize;		/* bufctl plus object, rounded */
+	unsigned kc_perslab;
+	int (*kc_ctor)(void *obj);
+	void (*kc_dtor)(void *obj);
+
+	struct spinlock kc_lock;	/* covers everything below */
+	/*
+	 * Slabs with free objects: partly used ones first, so that the
+	 * empty ones at the end stay empty and can be given back.
+	 */
+	struct kmem_slab *kc_head;
+	struct kmem_slab *kc_tail;
+	unsigned kc_nslabs;
+	unsigned kc_nempty;
+	unsigned kc_inuse;
+	unsigned kc_peak;
+	unsigned kc_allocs;		/* kmem_cache_alloc calls */
+	unsigned kc_ctors;		/* objects constructed */
+
+	struct kmem_cache *kc_next;
+};
+
+#define KMEM_OBJ(buf)  ((void *)((vaddr_t)(buf) + KMEM_HDRSIZE))
+#define KMEM_BUF(obj)  ((struct kmem_bufctl *)((vaddr_t)(obj) - KMEM_HDRSIZE))
+
+/* every cache, for kmem_cache_printstats */
+static struct spinlock kmem_caches_lock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *kmem_caches;
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, int (*ctor)(void *obj),
+		  void (*dtor)(void *obj))
+{
+	struct kmem_cache *kc;
+
+	kc = kmalloc(sizeof(struct kmem_cache));
+	if (kc == NULL) {
+		panic("kmem_cache_create: out of memory\n");
+	}
+	kc->kc_name = name;
+	kc->kc_bufsize = KMEM_HDRSIZE + ROUNDUP(size, KMEM_ALIGN);
+	kc->kc_perslab = (PAGE_SIZE - KMEM_SLABHDR) / kc->kc_bufsize;
+	KASSERT(kc->kc_perslab > 0);
+	kc->kc_ctor = ctor;
+	kc->kc_dtor = dtor;
+
+	spinlock_init(&kc->kc_lock);
+	kc->kc_head = kc->kc_tail = NULL;
+	kc->kc_nslabs = 0;
+	kc->kc_nempty = 0;
+	kc->kc_inuse = 0;
+	kc->kc_peak = 0;
+	kc->kc_allocs = 0;
+	kc->kc_ctors = 0;
+
+	spinlock_acquire(&kmem_caches_lock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_caches_lock);
+	return kc;
+}
+
+/* list operations; call with kc_lock held */
+static
+void
+kmem_slab_unlink(struct kmem_cache *kc, struct kmem_slab *slab)
+{
+	if (slab->ks_prev != NULL) {
+		slab->ks_prev->ks_next = slab->ks_next;
+	}
+	else {
+		kc->kc_head = slab->ks_next;
+	}
+	if (slab->ks_next != NULL) {
+		slab->ks_next->ks_prev = slab->ks_prev;
+	}
+	else {
+		kc->kc_tail = slab->ks_prev;
+	}
+}
+
+static
+void
+kmem_slab_addhead(struct kmem_cache *kc, struct kmem_slab *slab)
+{
+	slab->ks_prev = NULL;
+	slab->ks_next = kc->kc_head;
+	if (kc->kc_head != NULL) {
+		kc->kc_head->ks_prev = slab;
+	}
+	else {
+		kc->kc_tail = slab;
+	}
+	kc->kc_head = slab;
+}
+
+static
+void
+kmem_slab_addtail(struct kmem_cache *kc, struct kmem_slab *slab)
+{
+	slab->ks_next = NULL;
+	slab->ks_prev = kc->kc_tail;
+	if (kc->kc_tail != NULL) {
+		kc->kc_tail->ks_next = slab;
+	}
+	else {
+		kc->kc_head = slab;
+	}
+	kc->kc_tail = slab;
+}
+
+/*
+ * Destruct the free objects on SLAB and give its page back, unless it
+ * came from ram_stealmem; free_kpages can't take those.
+ */
+static
+void
+kmem_slab_destroy(struct kmem_cache *kc, struct kmem_slab *slab)
+{
+	struct kmem_bufctl *buf;
+
+	for (buf = slab->ks_free; buf != NULL; buf = buf->kb_next) {
+		if (kc->kc_dtor != NULL) {
+			kc->kc_dtor(KMEM_OBJ(buf));
+		}
+	}
+	if (!slab->ks_stolen) {
+		free_kpages((vaddr_t)slab);
+	}
+}
+
+/*
+ * Get a page and construct a slab's worth of objects on it. Called
+ * without kc_lock, since both may sleep.
+ */
+static
+struct kmem_slab *
+kmem_slab_create(struct kmem_cache *kc)
+{
+	struct kmem_slab *slab;
+	struct kmem_bufctl *buf;
+	vaddr_t page;
+	unsigned i;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		return NULL;
+	}
+	slab = (struct kmem_slab *)page;
+	slab->ks_cache = kc;
+	slab->ks_free = NULL;
+	slab->ks_nfree = 0;
+	slab->ks_stolen = kpage_isstolen(page);
+
+	for (i=0; i<kc->kc_perslab; i++) {
+		buf = (struct kmem_bufctl *)(page + KMEM_SLABHDR +
+					     i * kc->kc_bufsize);
+		if (kc->kc_ctor != NULL && kc->kc_ctor(KMEM_OBJ(buf)) != 0) {
+			kmem_slab_destroy(kc, slab);
+			return NULL;
+		}
+		buf->kb_next = slab->ks_free;
+		slab->ks_free = buf;
+		slab->ks_nfree++;
+	}
+	return slab;
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	struct kmem_slab *slab;
+	struct kmem_bufctl *buf;
+
+	spinlock_acquire(&kc->kc_lock);
+	if (kc->kc_head == NULL) {
+		spinlock_release(&kc->kc_lock);
+		slab = kmem_slab_create(kc);
+		if (slab == NULL) {
+			return NULL;
+		}
+		spinlock_acquire(&kc->kc_lock);
+		//somebody else may have added one meanwhile; that's fine
+		kmem_slab_addtail(kc, slab);
+		kc->kc_nslabs++;
+		kc->kc_nempty++;
+		kc->kc_ctors += kc->kc_perslab;
+	}
+
+	slab = kc->kc_head;
+	KASSERT(slab->ks_nfree > 0);
+	if (slab->ks_nfree == kc->kc_perslab) {
+		kc->kc_nempty--;
+	}
+	buf = slab->ks_free;
+	slab->ks_free = buf->kb_next;
+	slab->ks_nfree--;
+	if (slab->ks_nfree == 0) {
+		kmem_slab_unlink(kc, slab);
+	}
+
+	kc->kc_allocs++;
+	kc->kc_inuse++;
+	if (kc->kc_inuse > kc->kc_peak) {
+		kc->kc_peak = kc->kc_inuse;
+	}
+	spinlock_release(&kc->kc_lock);
+
+	return KMEM_OBJ(buf);
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	struct kmem_slab *slab, *victim;
+	struct kmem_bufctl *buf;
+
+	KASSERT(obj != NULL);
+	slab = (struct kmem_slab *)((vaddr_t)obj & PAGE_FRAME);
+	KASSERT(slab->ks_cache == kc);
+	buf = KMEM_BUF(obj);
+	victim = NULL;
+
+	spinlock_acquire(&kc->kc_lock);
+	KASSERT(kc->kc_inuse > 0);
+	if (slab->ks_nfree == 0) {
+		kmem_slab_addhead(kc, slab);
+	}
+	buf->kb_next = slab->ks_free;
+	slab->ks_free = buf;
+	slab->ks_nfree++;
+	kc->kc_inuse--;
+
+	if (slab->ks_nfree == kc->kc_perslab) {
+		kmem_slab_unlink(kc, slab);
+		if (kc->kc_nempty > 0 && !slab->ks_stolen) {
+			//one empty slab is plenty; early ones stay anyway
+			kc->kc_nslabs--;
+			victim = slab;
+		}
+		else {
+			kmem_slab_addtail(kc, slab);
+			kc->kc_nempty++;
+		}
+	}
+	spinlock_release(&kc->kc_lock);
+
+	if (victim != NULL) {
+		kmem_slab_destroy(kc, victim);
+	}
+}
+
+void
+kmem_cache_printstats(void)
+{
+	struct kmem_cache *kc;
+
+	kprintf("%-12s %6s %6s %6s %6s %8s %8s\n", "cache", "size",
+		"inuse", "peak", "slabs", "allocs", "ctors");
+	spinlock_acquire(&kmem_caches_lock);
+	for (kc = kmem_caches; kc != NULL; kc = kc->kc_next) {
+		spinlock_acquire(&kc->kc_lock);
+		kprintf("%-12s %6lu %6u %6u %6u %8u %8u\n", kc->kc_name,
+			(unsigned long)(kc->kc_bufsize - KMEM_HDRSIZE),
+			kc->kc_inuse, kc->kc_peak, kc->kc_nslabs,
+			kc->kc_allocs, kc->kc_ctors);
+		spinlock_release(&kc->kc_lock);
+	}
+	spinlock_release(&kmem_caches_lock);
+}
@@ -0,0 +1,398 @@
+/*
+ * Page cache for memory-mapped files. See pagecache.h for details.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <stat.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <pagetable.h>
+#include <pagecache.h>
+
+struct pagecache {
+	struct vnode *pc_vnode;
+	struct lock *pc_lock;		/* covers pc_pages */
+	struct pagetable *pc_pages;	/* frames, indexed by file offset */
+	unsigned pc_refs;		/* covered by pagecache_lock */
+	struct pagecache *pc_next;
+	/* on the unused list while pc_refs is 0, also pagecache_lock's */
+	struct pagecache *pc_lrunext, *pc_lruprev;
+};
+
+/*
+ * Every cache, in use or not; few files are mapped at once, so a list
+ * will do. The ones nobody uses any more are also on an LRU list, most
+ * recently released first, so that running the same program again
+ * finds its text still there.
+ */
+static struct lock *pagecache_lock;
+static struct pagecache *pagecache_list;
+static struct pagecache *pagecache_lruhead, *pagecache_lrutail;
+
+void
+pagecache_bootstrap(void)
+{
+	pagecache_lock = lock_create("pagecache");
+	if (pagecache_lock == NULL) {
+		panic("pagecache_bootstrap: out of memory\n");
+	}
+}
+
+/* take PC off the unused list; called with pagecache_lock held */
+static
+void
+pagecache_lru_remove(struct pagecache *pc)
+{
+	if (pc->pc_lruprev != NULL) {
+		pc->pc_lruprev->pc_lrunext = pc->pc_lrunext;
+	}
+	else {
+		pagecache_lruhead = pc->pc_lrunext;
+	}
+	if (pc->pc_lrunext != NULL) {
+		pc->pc_lrunext->pc_lruprev = pc->pc_lruprev;
+	}
+	else {
+		pagecache_lrutail = pc->pc_lruprev;
+	}
+	pc->pc_lrunext = pc->pc_lruprev = NULL;
+}
+
+/* look V up; called with pagecache_lock held */
+static
+struct pagecache *
+pagecache_lookup(struct vnode *v)
+{
+	struct pagecache *pc;
+
+	for (pc = pagecache_list; pc != NULL; pc = pc->pc_next) {
+		if (pc->pc_vnode == v) {
+			if (pc->pc_refs == 0) {
+				pagecache_lru_remove(pc);
+			}
+			pc->pc_refs++;
+			return pc;
+		}
+	}
+	return NULL;
+}
+
+//pt_walk callback: let go of one cached frame
+static
+int
+pagecache_free_page(vaddr_t offset, pte_t *pte, void *data)
+{
+	(void)offset;
+	(void)data;
+
+	cache_droppage(pte);
+	return 0;
+}
+
+//pt_walk callback: stop at the first frame still cached
+static
+int
+pagecache_any_page(vaddr_t offset, pte_t *pte, void *data)
+{
+	(void)offset;
+	(void)pte;
+	(void)data;
+
+	return 1;
+}
+
+/*
+ * Free a cache that nobody can find any more, whose pages are all
+ * written back.
+ */
+static
+void
+pagecache_destroy(struct pagecache *pc)
+{
+	pt_walk(pc->pc_pages, pagecache_free_page, NULL);
+	pt_destroy(pc->pc_pages);
+	lock_destroy(pc->pc_lock);
+	vfs_close(pc->pc_vnode);
+	kfree(pc);
+}
+
+/* take PC out of the table; called with pagecache_lock held */
+static
+void
+pagecache_unlink(struct pagecache *pc)
+{
+	struct pagecache **pp;
+
+	for (pp = &pagecache_list; *pp != pc; pp = &(*pp)->pc_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = pc->pc_next;
+}
+
+/*
+ * Destroy the unused caches the clock has taken every page from, or
+ * with ALL every unused cache. Called with pagecache_lock held.
+ */
+static
+void
+pagecache_reap(bool all)
+{
+	struct pagecache *pc, *prev;
+
+	for (pc = pagecache_lrutail; pc != NULL; pc = prev) {
+		prev = pc->pc_lruprev;
+		if (all || pt_walk(pc->pc_pages, pagecache_any_page,
+				   NULL) == 0) {
+			pagecache_lru_remove(pc);
+			pagecache_unlink(pc);
+			pagecache_destroy(pc);
+		}
+	}
+}
+
+/* a new, empty cache for V, or NULL if out of memory */
+static
+struct pagecache *
+pagecache_create(struct vnode *v)
+{
+	struct pagecache *pc;
+
+	pc = kmalloc(sizeof(struct pagecache));
+	if (pc == NULL) {
+		return NULL;
+	}
+	pc->pc_lock = lock_create("pagecache");
+	if (pc->pc_lock == NULL) {
+		kfree(pc);
+		return NULL;
+	}
+	pc->pc_pages = pt_create();
+	if (pc->pc_pages == NULL) {
+		lock_destroy(pc->pc_lock);
+		kfree(pc);
+		return NULL;
+	}
+	//keep the file open for as long as its pages may be written back
+	VOP_INCOPEN(v);
+	VOP_INCREF(v);
+	pc->pc_vnode = v;
+	pc->pc_refs = 1;
+	pc->pc_lrunext = pc->pc_lruprev = NULL;
+	return pc;
+}
+
+struct pagecache *
+pagecache_get(struct vnode *v)
+{
+	struct pagecache *pc;
+
+	lock_acquire(pagecache_lock);
+	pc = pagecache_lookup(v);
+	if (pc != NULL) {
+		lock_release(pagecache_lock);
+		return pc;
+	}
+
+	pagecache_reap(false);
+	pc = pagecache_create(v);
+	if (pc == NULL) {
+		//short of memory: the unused caches have to go after all
+		pagecache_reap(true);
+		pc = pagecache_create(v);
+		if (pc == NULL) {
+			lock_release(pagecache_lock);
+			return NULL;
+		}
+	}
+	pc->pc_next = pagecache_list;
+	pagecache_list = pc;
+	lock_release(pagecache_lock);
+	return pc;
+}
+
+struct pagecache *
+pagecache_find(struct vnode *v)
+{
+	struct pagecache *pc;
+
+	lock_acquire(pagecache_lock);
+	pc = pagecache_lookup(v);
+	lock_release(pagecache_lock);
+	return pc;
+}
+
+void
+pagecache_ref(struct pagecache *pc)
+{
+	lock_acquire(pagecache_lock);
+	KASSERT(pc->pc_refs > 0);
+	pc->pc_refs++;
+	lock_release(pagecache_lock);
+}
+
+//pt_walk callback: the page is written back, so the clock may take it
+static
+int
+pagecache_clean_page(vaddr_t offset, pte_t *pte, void *data)
+{
+	(void)offset;
+	(void)data;
+
+	cache_cleanpage(pte);
+	return 0;
+}
+
+void
+pagecache_release(struct pagecache *pc)
+{
+	int result;
+
+	lock_acquire(pagecache_lock);
+	KASSERT(pc->pc_refs > 0);
+	pc->pc_refs--;
+	if (pc->pc_refs > 0) {
+		lock_release(pagecache_lock);
+		return;
+	}
+
+	//nobody maps it now, and nobody can until we let go of the lock
+	result = pagecache_sync(pc);
+	if (result) {
+		kprintf("pagecache: lost writes to a mapped file: %s\n",
+			strerror(result));
+		pagecache_unlink(pc);
+		pagecache_destroy(pc);
+		lock_release(pagecache_lock);
+		return;
+	}
+	pt_walk(pc->pc_pages, pagecache_clean_page, NULL);
+
+	//kept until memory runs short, in case the file is used again
+	pc->pc_lruprev = NULL;
+	pc->pc_lrunext = pagecache_lruhead;
+	if (pagecache_lruhead != NULL) {
+		pagecache_lruhead->pc_lruprev = pc;
+	}
+	else {
+		pagecache_lrutail = pc;
+	}
+	pagecache_lruhead = pc;
+	lock_release(pagecache_lock);
+}
+
+void
+pagecache_shutdown(void)
+{
+	lock_acquire(pagecache_lock);
+	pagecache_reap(true);
+	lock_release(pagecache_lock);
+}
+
+int
+pagecache_getpage(struct pagecache *pc, off_t offset, paddr_t *ret,
+		  bool *fromdisk)
+{
+	struct iovec iov;
+	struct uio ku;
+	pte_t *pte;
+	paddr_t pa;
+	int result;
+
+	KASSERT(offset % PAGE_SIZE == 0);
+
+	lock_acquire(pc->pc_lock);
+	pte = pt_lookup_alloc(pc->pc_pages, (vaddr_t)offset);
+	if (pte == NULL) {
+		lock_release(pc->pc_lock);
+		return ENOMEM;
+	}
+
+	*fromdisk = false;
+	//the clock may have taken it since, if nobody had it mapped
+	pa = cache_getpage(pte);
+	if (pa == 0) {
+		pa = alloc_upage();
+		if (pa == 0) {
+			lock_release(pc->pc_lock);
+			return ENOMEM;
+		}
+		//anything past the end of the file is left zero
+		uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(pa), PAGE_SIZE,
+			  offset, UIO_READ);
+		result = VOP_READ(pc->pc_vnode, &ku);
+		if (result) {
+			free_upage(pa);
+			lock_release(pc->pc_lock);
+			return result;
+		}
+		cache_putpage(pte, pa);
+		*fromdisk = true;
+	}
+	lock_release(pc->pc_lock);
+	*ret = pa;
+	return 0;
+}
+
+void
+pagecache_dirty(struct pagecache *pc, off_t offset)
+{
+	pte_t *pte;
+
+	lock_acquire(pc->pc_lock);
+	pte = pt_lookup(pc->pc_pages, (vaddr_t)offset);
+	//only pages somebody has mapped can be written
+	KASSERT(pte != NULL && (*pte & PTE_VALID));
+	*pte |= PTE_DIRTY;
+	lock_release(pc->pc_lock);
+}
+
+struct pagecache_sync_args {
+	struct vnode *v;
+	off_t filesize;
+};
+
+//pt_walk callback: write one page back if it has been changed
+static
+int
+pagecache_sync_page(vaddr_t offset, pte_t *pte, void *data)
+{
+	struct pagecache_sync_args *args = data;
+	struct iovec iov;
+	struct uio ku;
+	size_t len;
+
+	if (!(*pte & PTE_DIRTY) || (off_t)offset >= args->filesize) {
+		return 0;
+	}
+	len = PAGE_SIZE;
+	if (args->filesize - offset < PAGE_SIZE) {
+		len = args->filesize - offset;
+	}
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(PTE_PADDR(*pte)), len,
+		  offset, UIO_WRITE);
+	return VOP_WRITE(args->v, &ku);
+}
+
+int
+pagecache_sync(struct pagecache *pc)
+{
+	struct pagecache_sync_args args;
+	struct stat st;
+	int result;
+
+	lock_acquire(pc->pc_lock);
+	result = VOP_STAT(pc->pc_vnode, &st);
+	if (result) {
+		lock_release(pc->pc_lock);
+		return result;
+	}
+	args.v = pc->pc_vnode;
+	args.filesize = st.st_size;
+	result = pt_walk(pc->pc_pages, pagecache_sync_page, &args);
+	lock_release(pc->pc_lock);
+	return result;
+}
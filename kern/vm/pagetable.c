@@ -0,0 +1,88 @@
+/*
+ * Two-level user page tables. See pagetable.h for details.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <pagetable.h>
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+
+	//exactly a page, and all-NULL is all-zero
+	KASSERT(sizeof(struct pagetable) == PAGE_SIZE);
+	pt = (struct pagetable *)alloc_zkpage();
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i;
+
+	//whole pages from alloc_zkpage, so straight back to the page allocator
+	for (i = 0; i < PT_L1_ENTRIES; i++) {
+		if (pt->pt_dir[i] != NULL) {
+			free_kpages((vaddr_t)pt->pt_dir[i]);
+		}
+	}
+	free_kpages((vaddr_t)pt);
+}
+
+pte_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr)
+{
+	pte_t *l2;
+
+	l2 = pt->pt_dir[PT_L1_INDEX(vaddr)];
+	if (l2 == NULL) {
+		return NULL;
+	}
+	return &l2[PT_L2_INDEX(vaddr)];
+}
+
+pte_t *
+pt_lookup_alloc(struct pagetable *pt, vaddr_t vaddr)
+{
+	pte_t *l2;
+	unsigned l1index;
+
+	l1index = PT_L1_INDEX(vaddr);
+	l2 = pt->pt_dir[l1index];
+	if (l2 == NULL) {
+		l2 = (pte_t *)alloc_zkpage();
+		if (l2 == NULL) {
+			return NULL;
+		}
+		pt->pt_dir[l1index] = l2;
+	}
+	return &l2[PT_L2_INDEX(vaddr)];
+}
+
+int
+pt_walk(struct pagetable *pt,
+	int (*func)(vaddr_t vaddr, pte_t *pte, void *data), void *data)
+{
+	unsigned i, j;
+	pte_t *l2;
+	int result;
+
+	for (i = 0; i < PT_L1_ENTRIES; i++) {
+		l2 = pt->pt_dir[i];
+		if (l2 == NULL) {
+			continue;
+		}
+		for (j = 0; j < PT_L2_ENTRIES; j++) {
+			if (l2[j] == 0) {
+				continue;
+			}
+			result = func(PT_VADDR(i, j), &l2[j], data);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
@@ -14,11 +14,23 @@
 #include <lib.h>
 #include <synch.h>
 #include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <platform/maxcpus.h>
 #include <uw-vmstats.h>
 
 /* Counters for tracking statistics */
 static unsigned int stats_counts[VMSTAT_COUNT];
 
+/* vm_tlbrefill's counts, kept per cpu so that it takes no lock, and
+ * a cache line each so that they don't bounce between cpus either.
+ * Folded into stats_counts when printed. */
+static struct {
+  unsigned int free;
+  unsigned int replace;
+  char pad[64 - 2 * sizeof(unsigned int)];
+} stats_refills[MAXCPUS];
+
 struct spinlock stats_lock = SPINLOCK_INITIALIZER;
 
 /* Strings used in printing out the statistics */
@@ -33,7 +45,26 @@ static const char *stats_names[] = {
  /*  7 */ "Page Faults from ELF",
  /*  8 */ "Page Faults from Swapfile",
  /*  9 */ "Swapfile Writes",
+ /* 10 */ "ASIDs Assigned",
+ /* 11 */ "ASID Rollovers",
+ /* 12 */ "Zeroed Pool Hits",
+ /* 13 */ "Zeroed Pool Misses",
+ /* 14 */ "Page Faults from Mapped File",
+ /* 15 */ "Clock Second Chances",
+ /* 16 */ "Pages Evicted",
+ /* 17 */ "TLB Refills (fast path)",
+ /* 18 */ "TLB Faults (vm_fault)",
+};
+
+/* Working sets of the last few processes to exit, oldest overwritten */
+struct vmstats_procrec {
+  char name[16];
+  unsigned maxresident;
+  unsigned faults;
+  unsigned msecs;
 };
+static struct vmstats_procrec stats_procs[VMSTAT_PROCS];
+static unsigned stats_nprocs;   /* ever recorded */
 
 
 /* ---------------------------------------------------------------------- */
@@ -46,6 +77,19 @@ vmstats_inc(unsigned int index)
     spinlock_release(&stats_lock);
 }
 
+/* ---------------------------------------------------------------------- */
+/* Call with interrupts off, so that we stay on this cpu */
+void
+vmstats_refill(bool replace)
+{
+  if (replace) {
+    stats_refills[curcpu->c_number].replace++;
+  }
+  else {
+    stats_refills[curcpu->c_number].free++;
+  }
+}
+
 /* ---------------------------------------------------------------------- */
 void
 vmstats_init(void)
@@ -83,7 +127,29 @@ _vmstats_init(void)
   for (i=0; i<VMSTAT_COUNT; i++) {
     stats_counts[i] = 0;
   }
+  for (i=0; i<MAXCPUS; i++) {
+    stats_refills[i].free = 0;
+    stats_refills[i].replace = 0;
+  }
+  stats_nprocs = 0;
+
+}
+
+/* ---------------------------------------------------------------------- */
+void
+vmstats_proc(const char *name, unsigned maxresident, unsigned faults,
+             unsigned msecs)
+{
+  struct vmstats_procrec *rec;
 
+  spinlock_acquire(&stats_lock);
+    rec = &stats_procs[stats_nprocs % VMSTAT_PROCS];
+    snprintf(rec->name, sizeof(rec->name), "%s", name);
+    rec->maxresident = maxresident;
+    rec->faults = faults;
+    rec->msecs = msecs;
+    stats_nprocs++;
+  spinlock_release(&stats_lock);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -102,6 +168,21 @@ vmstats_print(void)
   int tlb_faults = 0;
   int elf_plus_swap_reads = 0;
   int disk_reads = 0;
+  unsigned int zero_pool_takes = 0;
+  unsigned n, first;
+  struct vmstats_procrec *rec;
+
+  /* each refill was a TLB fault, a reload and a fast path refill */
+  for (i=0; i<MAXCPUS; i++) {
+    n = stats_refills[i].free + stats_refills[i].replace;
+    stats_counts[VMSTAT_TLB_FAULT] += n;
+    stats_counts[VMSTAT_TLB_RELOAD] += n;
+    stats_counts[VMSTAT_TLB_FASTPATH] += n;
+    stats_counts[VMSTAT_TLB_FAULT_FREE] += stats_refills[i].free;
+    stats_counts[VMSTAT_TLB_FAULT_REPLACE] += stats_refills[i].replace;
+    stats_refills[i].free = 0;
+    stats_refills[i].replace = 0;
+  }
 
   kprintf("VMSTATS:\n");
   for (i=0; i<VMSTAT_COUNT; i++) {
@@ -112,7 +193,8 @@ vmstats_print(void)
   free_plus_replace = stats_counts[VMSTAT_TLB_FAULT_FREE] + stats_counts[VMSTAT_TLB_FAULT_REPLACE];
   disk_plus_zeroed_plus_reload = stats_counts[VMSTAT_PAGE_FAULT_DISK] +
     stats_counts[VMSTAT_PAGE_FAULT_ZERO] + stats_counts[VMSTAT_TLB_RELOAD];
-  elf_plus_swap_reads = stats_counts[VMSTAT_ELF_FILE_READ] + stats_counts[VMSTAT_SWAP_FILE_READ];
+  elf_plus_swap_reads = stats_counts[VMSTAT_ELF_FILE_READ] + stats_counts[VMSTAT_SWAP_FILE_READ] +
+    stats_counts[VMSTAT_MAPPED_FILE_READ];
   disk_reads = stats_counts[VMSTAT_PAGE_FAULT_DISK];
 
   kprintf("VMSTAT TLB Faults with Free + TLB Faults with Replace = %d\n", free_plus_replace);
@@ -128,10 +210,25 @@ vmstats_print(void)
       tlb_faults, disk_plus_zeroed_plus_reload); 
   }
 
-  kprintf("VMSTAT ELF File reads + Swapfile reads = %d\n", elf_plus_swap_reads);
+  kprintf("VMSTAT ELF File reads + Swapfile reads + Mapped File reads = %d\n", elf_plus_swap_reads);
   if (disk_reads != elf_plus_swap_reads) {
-    kprintf("WARNING: ELF File reads + Swapfile reads != Page Faults (Disk) %d\n",
+    kprintf("WARNING: ELF File reads + Swapfile reads + Mapped File reads != Page Faults (Disk) %d\n",
       elf_plus_swap_reads);
   }
+
+  zero_pool_takes = stats_counts[VMSTAT_ZERO_POOL_HIT] + stats_counts[VMSTAT_ZERO_POOL_MISS];
+  if (zero_pool_takes > 0) {
+    kprintf("VMSTAT Zeroed Pool hit rate = %d%%\n",
+      stats_counts[VMSTAT_ZERO_POOL_HIT] * 100 / zero_pool_takes);
+  }
+
+  /* oldest first */
+  first = stats_nprocs > VMSTAT_PROCS ? stats_nprocs - VMSTAT_PROCS : 0;
+  for (n = first; n < stats_nprocs; n++) {
+    rec = &stats_procs[n % VMSTAT_PROCS];
+    kprintf("VMSTAT process %-15s peak resident %6u pages, %8u page faults, %8u faults/sec\n",
+      rec->name, rec->maxresident, rec->faults,
+      rec->msecs > 0 ? (unsigned)((uint64_t)rec->faults * 1000 / rec->msecs) : rec->faults);
+  }
 }
 /* ---------------------------------------------------------------------- */
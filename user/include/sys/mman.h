@@ -0,0 +1,27 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+/*
+ * Memory-mapped files.
+ */
+
+#include <sys/types.h>
+
+/*
+ * Get the PROT_ and MAP_ flags from the kernel
+ */
+#include <kern/mman.h>
+
+/*
+ * mmap maps LEN bytes of the open file FD, starting at the page-aligned
+ * OFFSET, and returns where it put them, or MAP_FAILED. ADDR is only a
+ * hint and is currently ignored. Pages are read in from the file as
+ * they are first touched. With MAP_SHARED, writes go back to the file
+ * on munmap, fsync, or exit; they never make the file longer.
+ *
+ * munmap must be given a whole mapping, as returned by mmap.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+
+#endif /* _SYS_MMAN_H_ */
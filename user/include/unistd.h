@@ -56,6 +56,8 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     mmap:     sys/mman.h
+ *     munmap:   sys/mman.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -154,6 +156,8 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+/* run only on the cpus whose bits are set in cpumask; inherited by fork */
+int setaffinity(unsigned int cpumask);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -0,0 +1,135 @@
+/*
+ * hogprobe
+ *
+ * 	measure how long an interactive process waits for the CPU
+ * 	while hogs are running
+ *
+ *   starts hogparty and NHOGS plain CPU hogs, then repeatedly
+ *   writes one character (which sleeps until the console is done
+ *   with it) and does a little work, timing each round. With
+ *   round-robin scheduling each round waits behind every hog; a
+ *   scheduler that favours threads that sleep should keep the
+ *   rounds short however many hogs there are.
+ *
+ *   usage: hogprobe [nhogs]
+ *
+ *   relies on fork, execv, waitpid, _exit, write and __time
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFHOGS     4
+#define MAXHOGS     16
+#define HOGLOOPS    2000000	/* work for each plain hog */
+#define NPROBES     100
+#define PROBELOOPS  1000	/* work for each probe round */
+
+static char *hpargv[2] = { (char *)"hogparty", NULL };
+
+static
+pid_t
+spawnv(const char *prog, char **argv)
+{
+  pid_t pid = fork();
+  switch (pid) {
+  case -1:
+    err(1, "fork");
+  case 0:
+    /* child */
+    execv(prog, argv);
+    err(1, "%s", prog);
+  default:
+    /* parent */
+    break;
+  }
+  return pid;
+}
+
+static
+pid_t
+spawnhog(void)
+{
+  volatile int i;
+  pid_t pid = fork();
+  switch (pid) {
+  case -1:
+    err(1, "fork");
+  case 0:
+    /* child */
+    for (i=0; i<HOGLOOPS; i++)
+      ;
+    _exit(0);
+  default:
+    /* parent */
+    break;
+  }
+  return pid;
+}
+
+/* one interactive round; returns how long it took in microseconds */
+static
+unsigned long
+probe(void)
+{
+  time_t s0, s1;
+  unsigned long ns0, ns1;
+  volatile int i;
+
+  __time(&s0, &ns0);
+  if (write(STDOUT_FILENO, ".", 1) != 1) {
+    err(1, "write");
+  }
+  for (i=0; i<PROBELOOPS; i++)
+    ;
+  __time(&s1, &ns1);
+  return (s1 - s0) * 1000000UL + ns1 / 1000 - ns0 / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  pid_t pids[MAXHOGS + 1];
+  int nhogs, npids, i, status;
+  unsigned long us, total, best, worst;
+
+  nhogs = DEFHOGS;
+  if (argc > 1) {
+    nhogs = atoi(argv[1]);
+  }
+  if (nhogs < 0 || nhogs > MAXHOGS) {
+    errx(1, "usage: hogprobe [nhogs], with at most %d hogs", MAXHOGS);
+  }
+
+  npids = 0;
+  pids[npids++] = spawnv("/uw-testbin/hogparty", hpargv);
+  for (i=0; i<nhogs; i++) {
+    pids[npids++] = spawnhog();
+  }
+
+  total = worst = 0;
+  best = 0;
+  for (i=0; i<NPROBES; i++) {
+    us = probe();
+    total += us;
+    if (i == 0 || us < best) {
+      best = us;
+    }
+    if (us > worst) {
+      worst = us;
+    }
+  }
+
+  for (i=0; i<npids; i++) {
+    if (waitpid(pids[i], &status, 0) < 0) {
+      err(1, "waitpid");
+    }
+  }
+
+  printf("\nhogprobe: %d hogs, %d rounds: min %lu avg %lu max %lu usec\n",
+	 nhogs, NPROBES, best, total / NPROBES, worst);
+  return 0;
+}
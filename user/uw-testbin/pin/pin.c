@@ -0,0 +1,36 @@
+/*
+ * pin
+ *
+ * 	run a program on a chosen set of cpus
+ *
+ *   usage: pin cpumask program [args...]
+ *
+ *   cpumask is a number whose bit n allows cpu n, so "pin 2 prog"
+ *   keeps prog and everything it forks on cpu 1.
+ *
+ *   relies on setaffinity and execv
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+int
+main(int argc, char *argv[])
+{
+  int mask;
+
+  if (argc < 3) {
+    errx(1, "usage: pin cpumask program [args...]");
+  }
+  mask = atoi(argv[1]);
+  if (mask <= 0) {
+    errx(1, "%s: bad cpu mask", argv[1]);
+  }
+  if (setaffinity((unsigned)mask) < 0) {
+    err(1, "setaffinity");
+  }
+  execv(argv[2], &argv[2]);
+  err(1, "%s", argv[2]);
+}
@@ -0,0 +1,52 @@
+/*
+ * pinaway
+ *
+ * 	pin a lone process to each cpu in turn
+ *
+ *   run with nothing else going on. Each setaffinity that names a
+ *   cpu other than the one the process is on has to move it there
+ *   even though that cpu has nothing else to run; if it can't, the
+ *   test hangs. Stops at the first cpu that doesn't exist.
+ *
+ *   usage: pinaway
+ *
+ *   relies on setaffinity
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define ROUNDS  20
+#define MAXCPU  32
+#define WORK    10000	/* spin a little on each cpu */
+
+int
+main(void)
+{
+  int round, cpu, ncpus;
+  volatile int i;
+
+  ncpus = 0;
+  for (round = 0; round < ROUNDS; round++) {
+    for (cpu = 0; cpu < MAXCPU; cpu++) {
+      if (setaffinity(1U << cpu) < 0) {
+        if (errno == EINVAL && cpu > 0) {
+          break;
+        }
+        err(1, "setaffinity(cpu %d)", cpu);
+      }
+      for (i = 0; i < WORK; i++) {
+        /* nothing */
+      }
+    }
+    ncpus = cpu;
+  }
+  if (setaffinity(~0U) < 0) {
+    err(1, "setaffinity(all)");
+  }
+  printf("pinaway: moved across %d cpus %d times: passed\n", ncpus, ROUNDS);
+  return 0;
+}